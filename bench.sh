@@ -0,0 +1,36 @@
+#!/bin/bash
+
+set -e
+
+# 在独立的网络命名空间中运行基准测试：
+# - 回环上的测试接口需要CAP_NET_RAW，以非特权用户运行时使用用户命名空间；
+# - 不会影响本机的路由表和接口。
+
+# 每个参数是一个套件及其参数，如 ./bench.sh "spf 1000,10000" exchange
+bench=build/linux/x86_64/debug/ospf-bench
+suites=(spf areas exchange lsu aging timer checksum alloc install fib)
+
+if [ $# -gt 0 ]; then
+	suites=("$@")
+fi
+
+function green() {
+	echo -e "\033[0;32m$1\033[0m"
+}
+
+make -s ospf-bench
+
+# 组播的洪泛报文也经由回环发送
+setup="ip link set lo up && ip route add 224.0.0.0/4 dev lo"
+
+run="$setup"
+for suite in "${suites[@]}"; do
+	run="$run && echo && $bench $suite"
+done
+
+green "[ bench ] ${suites[*]}"
+if [ "$(id -u)" -eq 0 ]; then
+	unshare -n sh -c "$run"
+else
+	unshare -rn sh -c "$run"
+fi
@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "interface.hpp"
+#include "neighbor.hpp"
+#include "transit.hpp"
+
+// 统计全局operator new，容器等使用内存池的分配不经过这里
+static std::atomic<uint64_t> new_calls(0);
+
+void *operator new(size_t size) {
+    new_calls++;
+    auto ptr = malloc(size != 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace Bench {
+
+uint64_t heap_allocs() {
+    return new_calls.load();
+}
+
+size_t rss_kb() {
+    long pages = 0, resident = 0;
+    auto file = fopen("/proc/self/statm", "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    if (fscanf(file, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(file);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+std::vector<size_t> parse_sizes(const char *arg, const std::vector<size_t>& defaults) {
+    if (arg == nullptr) {
+        return defaults;
+    }
+    std::vector<size_t> sizes;
+    std::string list = arg;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        auto end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        auto size = strtoull(list.substr(pos, end - pos).c_str(), nullptr, 10);
+        if (size > 0) {
+            sizes.push_back(size);
+        }
+        pos = end + 1;
+    }
+    return sizes.empty() ? defaults : sizes;
+}
+
+RouterLSA *make_router_lsa(in_addr_t rid, const std::vector<RouterLSA::Link>& links, uint32_t seq) {
+    auto rlsa = new RouterLSA();
+    rlsa->header.age = 0;
+    rlsa->header.options = 0x02;
+    rlsa->header.type = LSA::Type::ROUTER;
+    rlsa->header.link_state_id = rid;
+    rlsa->header.advertising_router = rid;
+    rlsa->header.sequence_number = seq;
+    rlsa->header.checksum = 0;
+    for (auto& link : links) {
+        rlsa->add_link(link);
+    }
+    rlsa->make_checksum();
+    return rlsa;
+}
+
+NetworkLSA *make_network_lsa(in_addr_t dr_addr, in_addr_t adv_rtr, in_addr_t mask,
+                             const std::vector<in_addr_t>& routers) {
+    auto nlsa = new NetworkLSA(mask);
+    nlsa->header.age = 0;
+    nlsa->header.options = 0x02;
+    nlsa->header.type = LSA::Type::NETWORK;
+    nlsa->header.link_state_id = dr_addr;
+    nlsa->header.advertising_router = adv_rtr;
+    nlsa->header.sequence_number = 0x80000001;
+    nlsa->header.checksum = 0;
+    for (auto router : routers) {
+        nlsa->add_attached_router(router);
+    }
+    nlsa->make_checksum();
+    return nlsa;
+}
+
+void install(Area *area, LSA::Base *lsa) {
+    area->lsdb.lock();
+    area->lsdb.add(lsa);
+    area->lsdb.unlock();
+}
+
+// 根的点对点接口地址为10.0.k.1，路由器的/32存根网络为11.0.0.0起，transit网络为172.16.0.0起的/30
+static in_addr_t root_intf_addr(size_t k) {
+    return 0x0a000001u + (static_cast<in_addr_t>(k) << 8);
+}
+
+static in_addr_t stub_addr(size_t i) {
+    return 0x0b000000u + static_cast<in_addr_t>(i);
+}
+
+static in_addr_t router_id(size_t i) {
+    return 0x64000000u + static_cast<in_addr_t>(i) + 1;
+}
+
+// 无向链路两个方向的度量相同
+static uint16_t link_metric(size_t a, size_t b, uint16_t max_metric) {
+    auto x = static_cast<uint32_t>(std::min(a, b) * 2654435761u + std::max(a, b) * 40503u);
+    return static_cast<uint16_t>(1 + (x >> 7) % max_metric);
+}
+
+Topology build_grid(Area *area, size_t routers, uint16_t max_metric) {
+    constexpr size_t WIDTH = 100;
+    Topology topo;
+    topo.max_metric = max_metric;
+    auto root = area->root_id;
+    auto p2p = [&](size_t a, size_t b) {
+        return RouterLSA::Link(router_id(b), 0, LSA::LinkType::POINT2POINT, link_metric(a, b, max_metric));
+    };
+    // 第i台路由器与右侧邻居共享的transit网络，由第i台路由器作为DR
+    auto has_net = [&](size_t i) { return i % 10 == 3 && i % WIDTH < WIDTH - 1 && i + 1 < routers; };
+    auto net_addr = [](size_t i) { return 0xac100000u + (static_cast<in_addr_t>(i) << 2); };
+
+    // 根接入网格左上角的4台路由器
+    std::vector<size_t> uplinks;
+    for (size_t i : {size_t(0), size_t(1), WIDTH, WIDTH + 1}) {
+        if (i < routers) {
+            uplinks.push_back(i);
+        }
+    }
+    std::vector<RouterLSA::Link> root_links;
+    for (size_t k = 0; k < uplinks.size(); ++k) {
+        root_links.emplace_back(router_id(uplinks[k]), root_intf_addr(k), LSA::LinkType::POINT2POINT, 1);
+    }
+    install(area, make_router_lsa(root, root_links));
+    topo.lsas++;
+
+    for (size_t i = 0; i < routers; ++i) {
+        std::vector<RouterLSA::Link> links;
+        if (i % WIDTH > 0) {
+            links.push_back(p2p(i, i - 1));
+        }
+        if (i % WIDTH < WIDTH - 1 && i + 1 < routers) {
+            links.push_back(p2p(i, i + 1));
+        }
+        if (i >= WIDTH) {
+            links.push_back(p2p(i, i - WIDTH));
+        }
+        if (i + WIDTH < routers) {
+            links.push_back(p2p(i, i + WIDTH));
+        }
+        if (std::find(uplinks.begin(), uplinks.end(), i) != uplinks.end()) {
+            links.emplace_back(root, 0, LSA::LinkType::POINT2POINT, 1);
+        }
+        if (has_net(i)) {
+            links.emplace_back(net_addr(i) + 1, net_addr(i) + 1, LSA::LinkType::TRANSIT,
+                               link_metric(i, i + 1, max_metric));
+        }
+        if (i > 0 && has_net(i - 1)) {
+            links.emplace_back(net_addr(i - 1) + 1, net_addr(i - 1) + 2, LSA::LinkType::TRANSIT,
+                               link_metric(i - 1, i, max_metric));
+        }
+        links.emplace_back(stub_addr(i), 0xffffffff, LSA::LinkType::STUB, 1);
+        install(area, make_router_lsa(router_id(i), links));
+        topo.routers.push_back(router_id(i));
+        topo.lsas++;
+        if (has_net(i)) {
+            install(area,
+                    make_network_lsa(net_addr(i) + 1, router_id(i), 0xfffffffc, {router_id(i), router_id(i + 1)}));
+            topo.lsas++;
+        }
+    }
+    return topo;
+}
+
+Topology build_clos(Area *area, size_t routers) {
+    // 每个pod有4台汇聚交换机和48台叶交换机，汇聚交换机连接全部4台脊交换机
+    constexpr size_t SPINES = 4;
+    constexpr size_t AGGS = 4;
+    constexpr size_t LEAVES = 48;
+    constexpr size_t POD = AGGS + LEAVES;
+    Topology topo;
+    auto root = area->root_id;
+    auto pods = std::max<size_t>(1, (routers - std::min(routers, SPINES) + POD - 1) / POD);
+    // 编号：脊交换机在前，之后每个pod先汇聚后叶
+    auto spine = [](size_t s) { return s; };
+    auto agg = [](size_t pod, size_t a) { return SPINES + pod * POD + a; };
+    auto leaf = [](size_t pod, size_t l) { return SPINES + pod * POD + AGGS + l; };
+    auto p2p = [](size_t i) { return RouterLSA::Link(router_id(i), 0, LSA::LinkType::POINT2POINT, 1); };
+
+    // 根是pod 0中额外的一台叶交换机
+    std::vector<RouterLSA::Link> root_links;
+    for (size_t a = 0; a < AGGS; ++a) {
+        root_links.emplace_back(router_id(agg(0, a)), root_intf_addr(a), LSA::LinkType::POINT2POINT, 1);
+    }
+    install(area, make_router_lsa(root, root_links));
+    topo.lsas++;
+
+    // 按整个pod构建，路由器数向上取整
+    auto total = SPINES + pods * POD;
+    for (size_t i = 0; i < total; ++i) {
+        std::vector<RouterLSA::Link> links;
+        if (i < SPINES) {
+            for (size_t pod = 0; pod < pods; ++pod) {
+                for (size_t a = 0; a < AGGS; ++a) {
+                    links.push_back(p2p(agg(pod, a)));
+                }
+            }
+        } else {
+            auto pod = (i - SPINES) / POD;
+            auto pos = (i - SPINES) % POD;
+            if (pos < AGGS) {
+                for (size_t s = 0; s < SPINES; ++s) {
+                    links.push_back(p2p(spine(s)));
+                }
+                for (size_t l = 0; l < LEAVES; ++l) {
+                    links.push_back(p2p(leaf(pod, l)));
+                }
+                if (pod == 0) {
+                    links.emplace_back(root, 0, LSA::LinkType::POINT2POINT, 1);
+                }
+            } else {
+                for (size_t a = 0; a < AGGS; ++a) {
+                    links.push_back(p2p(agg(pod, a)));
+                }
+            }
+        }
+        links.emplace_back(stub_addr(i), 0xffffffff, LSA::LinkType::STUB, 1);
+        install(area, make_router_lsa(router_id(i), links));
+        topo.routers.push_back(router_id(i));
+        topo.lsas++;
+    }
+    return topo;
+}
+
+void perturb(Area *area, const Topology& topo, Rand& rand, bool structural) {
+    auto rid = topo.routers[rand.below(topo.routers.size())];
+    area->lsdb.lock();
+    auto old_lsa = static_cast<RouterLSA *>(area->lsdb.get(LSA::Type::ROUTER, rid, rid));
+    std::vector<RouterLSA::Link> links(old_lsa->links().begin(), old_lsa->links().end());
+    auto seq = old_lsa->header.sequence_number + 1;
+    area->lsdb.unlock();
+
+    if (structural) {
+        auto is_stub = [](const RouterLSA::Link& link) { return link.type == LSA::LinkType::STUB; };
+        auto size = links.size();
+        links.erase(std::remove_if(links.begin(), links.end(), is_stub), links.end());
+        if (links.size() == size) {
+            links.emplace_back(stub_addr(rid - router_id(0)), 0xffffffff, LSA::LinkType::STUB, 1);
+        }
+        install(area, make_router_lsa(rid, links, seq));
+        return;
+    }
+
+    std::vector<size_t> p2p;
+    for (size_t i = 0; i < links.size(); ++i) {
+        if (links[i].type == LSA::LinkType::POINT2POINT) {
+            p2p.push_back(i);
+        }
+    }
+    if (!p2p.empty()) {
+        auto& link = links[p2p[rand.below(p2p.size())]];
+        link.metric = 1 + rand.below(std::max<uint16_t>(topo.max_metric, 2) * 2);
+    }
+    install(area, make_router_lsa(rid, links, seq));
+}
+
+bool open_loopback(Loopback& loop, Area *area, uint32_t mtu) {
+    loop.area = area;
+    loop.intf = new Interface(ntohl(inet_addr("127.0.0.1")), 0xff000000, area->area_id);
+    strcpy(loop.intf->name, "lo");
+    loop.intf->type = Interface::Type::P2P;
+    loop.intf->state = Interface::State::POINT2POINT;
+    loop.intf->mtu = mtu;
+    loop.intf->area = area;
+    if ((loop.intf->send_fd = socket(AF_INET, SOCK_RAW, IPPROTO_OSPF)) < 0) {
+        perror("open_loopback: socket (needs CAP_NET_RAW, run via bench.sh)");
+        delete loop.intf;
+        loop.intf = nullptr;
+        return false;
+    }
+    // 发往本机的报文也会交给这个套接字，不读取它们
+    shutdown(loop.intf->send_fd, SHUT_RD);
+    loop.nbr = new Neighbor(ntohl(inet_addr("127.0.0.2")), loop.intf);
+    loop.nbr->id = ntohl(inet_addr("2.2.2.2"));
+    loop.nbr->state = Neighbor::State::INIT;
+    loop.intf->neighbors.push_back(loop.nbr);
+    area->interfaces.push_back(loop.intf);
+    return true;
+}
+
+void close_loopback(Loopback& loop) {
+    auto& intfs = loop.area->interfaces;
+    intfs.erase(std::remove(intfs.begin(), intfs.end(), loop.intf), intfs.end());
+    // 邻居由接口释放
+    delete loop.intf;
+    loop.intf = nullptr;
+    loop.nbr = nullptr;
+}
+
+} // namespace Bench
+
+static const struct {
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+    const char *usage;
+} suites[] = {
+    {"spf", Bench::run_spf, "spf [routers,...]       full/incremental SPF on grid and Clos topologies"},
+    {"areas", Bench::run_areas, "areas [routers]         per-area SPF, serial vs worker pool"},
+    {"exchange", Bench::run_exchange, "exchange [routers,...]  DD exchange rounds and time vs LSDB size and MTU"},
+    {"lsu", Bench::run_lsu, "lsu [routers,...]       LSU packing: packets and time vs MTU"},
+    {"aging", Bench::run_aging, "aging [lsas,...]        LSDB memory, aging tick and MaxAge flush cost"},
+    {"timer", Bench::run_timer, "timer [timers]          timer wheel arm/cancel cost and firing lateness"},
+    {"checksum", Bench::run_checksum, "checksum                Fletcher/IP checksum throughput vs references"},
+    {"alloc", Bench::run_alloc, "alloc [routers,...]     heap allocations per received LSU"},
+    {"install", Bench::run_install, "install [routes,...]    kernel route install: ioctl vs netlink"},
+    {"fib", Bench::run_fib, "fib [prefixes,...]      PrefixTrie lookups/s, checked against a linear scan"},
+};
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2) {
+        for (auto& suite : suites) {
+            if (strcmp(argv[1], suite.name) == 0) {
+                return suite.run(argc - 2, argv + 2);
+            }
+        }
+    }
+    std::cerr << "usage: " << argv[0] << " <suite> [args]" << std::endl;
+    for (auto& suite : suites) {
+        std::cerr << "  " << suite.usage << std::endl;
+    }
+    return 1;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "area.hpp"
+#include "packet.hpp"
+
+class Interface;
+class Neighbor;
+
+/*
+ * 基准测试的公共部分：
+ * - 计时和随机数；
+ * - 合成拓扑：只通过LSDB::add安装构造出的LSA，与收到LSU后的路径相同；
+ * - 回环上的测试接口：发送的报文经由原始套接字发往本机，需要CAP_NET_RAW，由bench.sh在独立的网络命名空间中运行。
+ */
+namespace Bench {
+
+using Clock = std::chrono::steady_clock;
+
+static inline double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/* xorshift，结果只取决于种子，各次运行的拓扑相同 */
+struct Rand {
+    uint64_t state;
+    explicit Rand(uint64_t seed = 88172645463325252ull) : state(seed) {
+    }
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<uint32_t>(state >> 16);
+    }
+    uint32_t below(uint32_t n) {
+        return next() % n;
+    }
+};
+
+/* 屏蔽std::cout的输出（如邻居状态的变化），析构时恢复 */
+class Quiet {
+public:
+    Quiet() : saved(std::cout.rdbuf(nullptr)) {
+    }
+    ~Quiet() {
+        std::cout.rdbuf(saved);
+        std::cout.clear();
+    }
+
+private:
+    std::streambuf *saved;
+};
+
+/* 由逗号分隔的数量列表，空时返回默认值 */
+std::vector<size_t> parse_sizes(const char *arg, const std::vector<size_t>& defaults);
+
+/* 构造LSA，序列号和链路由调用者指定，已计算校验和 */
+RouterLSA *make_router_lsa(in_addr_t rid, const std::vector<RouterLSA::Link>& links, uint32_t seq = 0x80000001);
+NetworkLSA *make_network_lsa(in_addr_t dr_addr, in_addr_t adv_rtr, in_addr_t mask,
+                             const std::vector<in_addr_t>& routers);
+/* 加锁后安装到区域的LSDB */
+void install(Area *area, LSA::Base *lsa);
+
+/* 合成拓扑：根（本路由器）经由点对点链路接入，每台路由器另有一个/32的存根网络 */
+struct Topology {
+    // 除根以外的路由器
+    std::vector<in_addr_t> routers;
+    size_t lsas = 0;
+    uint16_t max_metric = 1;
+};
+/* 每行100台路由器的网格，度量随机；每10台路由器与右侧邻居共享一个transit网络 */
+Topology build_grid(Area *area, size_t routers, uint16_t max_metric = 16);
+/* 三层Clos（脊、汇聚、叶），度量相同，根是一台叶交换机，经4条上行链路形成等价多路径；路由器数按pod向上取整 */
+Topology build_clos(Area *area, size_t routers);
+/*
+ * 重新安装一台随机路由器的Router-LSA，其中一条点对点链路的度量随机改变；
+ * structural时改为增删存根网络：有存根链路则全部删除，没有则加回该路由器原有的/32存根网络，使结点被回收和重新加入
+ */
+void perturb(Area *area, const Topology& topo, Rand& rand, bool structural = false);
+
+/* 回环上的测试接口，带一个处于state状态的邻居，接口以mtu发送 */
+struct Loopback {
+    Area *area;
+    Interface *intf;
+    Neighbor *nbr;
+};
+/* 失败时返回false，接口未能打开原始套接字 */
+bool open_loopback(Loopback& loop, Area *area, uint32_t mtu);
+void close_loopback(Loopback& loop);
+
+/* 进程常驻内存（RSS），单位KB */
+size_t rss_kb();
+
+/* 全局operator new的调用次数，由bench.cpp中的替换版本统计 */
+uint64_t heap_allocs();
+
+/* 各测试套件，args为套件名之后的参数，返回进程退出码 */
+int run_spf(int argc, char *argv[]);
+int run_areas(int argc, char *argv[]);
+int run_exchange(int argc, char *argv[]);
+int run_lsu(int argc, char *argv[]);
+int run_aging(int argc, char *argv[]);
+int run_timer(int argc, char *argv[]);
+int run_checksum(int argc, char *argv[]);
+int run_alloc(int argc, char *argv[]);
+int run_install(int argc, char *argv[]);
+int run_fib(int argc, char *argv[]);
+
+} // namespace Bench
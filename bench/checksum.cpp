@@ -0,0 +1,99 @@
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench.hpp"
+#include "utils.hpp"
+
+namespace Bench {
+
+/* 逐字节、每步取模的Fletcher校验和（ISO 8473附录C），off处的两个字节按0处理 */
+static uint16_t fletcher16_ref(const uint8_t *data, size_t len, size_t off) {
+    int32_t c0 = 0, c1 = 0;
+    for (size_t i = 0; i < len; ++i) {
+        auto byte = (i == off || i == off + 1) ? 0 : data[i];
+        c0 = (c0 + byte) % 255;
+        c1 = (c1 + c0) % 255;
+    }
+    int32_t x = ((static_cast<int32_t>((len - off - 1) % 255) * c0 - c1) % 255 + 255) % 255;
+    if (x == 0) {
+        x = 255;
+    }
+    int32_t y = ((510 - c0 - x) % 255 + 255) % 255;
+    if (y == 0) {
+        y = 255;
+    }
+    return (x << 8) | y;
+}
+
+/* 逐个16位字累加的反码和，结果为网络字节序 */
+static uint16_t inet_ref(const uint8_t *data, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += data[i] << 8 | data[i + 1];
+    }
+    if (len & 1) {
+        sum += data[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(static_cast<uint16_t>(~sum));
+}
+
+/* 随机长度和校验和位置下与参考实现比对，并校验写入校验和后的数据，返回不一致的次数 */
+static int check(Rand& rand, std::vector<uint8_t>& buf) {
+    int failures = 0;
+    for (int run = 0; run < 10000; ++run) {
+        auto len = 16 + rand.below(buf.size() - 16);
+        // 从未对齐的位置开始
+        auto data = buf.data() + rand.below(16);
+        len = std::min<size_t>(len, buf.data() + buf.size() - data);
+        auto off = rand.below(len - 1);
+        auto sum = fletcher16(data, len, off);
+        failures += sum != fletcher16_ref(data, len, off);
+        uint8_t saved[2] = {data[off], data[off + 1]};
+        data[off] = sum >> 8;
+        data[off + 1] = sum & 0xff;
+        failures += !fletcher16_verify(data, len);
+        data[off] = saved[0];
+        data[off + 1] = saved[1];
+        failures += crc_checksum(data, len) != inet_ref(data, len);
+    }
+    return failures;
+}
+
+int run_checksum(int argc, char *argv[]) {
+    std::vector<uint8_t> buf(65536 + 16);
+    Rand rand;
+    for (auto& byte : buf) {
+        byte = rand.next();
+    }
+    // 每种长度处理约256MB
+    constexpr double TOTAL = 256.0 * 1024 * 1024;
+    std::cout << "Checksum throughput (GB/s)" << std::endl
+              << "  bytes  fletcher  fletcher_ref     inet  inet_ref" << std::endl;
+    volatile uint32_t sink = 0;
+    auto rate = [&](size_t len, uint16_t (*sum)(const uint8_t *, size_t)) {
+        auto runs = static_cast<size_t>(TOTAL / len);
+        auto start = Clock::now();
+        for (size_t i = 0; i < runs; ++i) {
+            sink = sink + sum(buf.data() + (i & 7), len);
+        }
+        return TOTAL / (elapsed_ms(start) * 1e6);
+    };
+    for (size_t len : {64, 1500, 9000, 65536}) {
+        auto fletcher = rate(len, [](const uint8_t *data, size_t len) { return fletcher16(data, len, 14); });
+        auto fletcher_ref = rate(len, [](const uint8_t *data, size_t len) { return fletcher16_ref(data, len, 14); });
+        auto inet = rate(len, [](const uint8_t *data, size_t len) { return crc_checksum(data, len); });
+        auto ref = rate(len, inet_ref);
+        std::cout << std::setw(7) << len << std::fixed << std::setprecision(2) << std::setw(10) << fletcher
+                  << std::setw(14) << fletcher_ref << std::setw(9) << inet << std::setw(10) << ref << std::endl;
+    }
+    auto failures = check(rand, buf);
+    std::cout << "mismatches: " << failures << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace Bench
@@ -0,0 +1,189 @@
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+
+#include "bench.hpp"
+#include "interface.hpp"
+#include "neighbor.hpp"
+#include "transit.hpp"
+
+namespace Bench {
+
+// 252字节的MTU每个DD装10条LSA头部，与按MTU装包之前的固定数量相同
+static const uint32_t MTUS[] = {252, 1500, 9000};
+// 估算总时间时假设的往返时延
+constexpr double RTT_MS = 1.0;
+
+/* 数据库中所有LSA的头部（网络字节序），由脚本化的邻居在DD中发出 */
+static std::vector<LSA::Header> summary_headers(Area *area) {
+    std::vector<LSA::Header> headers;
+    area->lsdb.lock();
+    auto snapshot = area->lsdb.snapshot();
+    area->lsdb.unlock();
+    auto collect = [&](const LSA::Base *lsa) {
+        headers.push_back(*reinterpret_cast<const LSA::Header *>(lsa->data.data()));
+    };
+    for (auto& lsa : *snapshot->router_lsas) {
+        collect(lsa.get());
+    }
+    for (auto& lsa : *snapshot->network_lsas) {
+        collect(lsa.get());
+    }
+    return headers;
+}
+
+struct ExchangeResult {
+    size_t rounds = 0;
+    double cpu_ms = 0;
+    bool full = false;
+};
+
+/*
+ * 邻居（2.2.2.2）的路由器标识较大，作为master逐个发出DD并等待本路由器（slave）的回复：
+ * - 双方的摘要相同，不产生LSR，交换结束后直接进入Full；
+ * - 邻居的每个DD即一个往返，slave的回复取自last_dd_data。
+ */
+static ExchangeResult exchange(Area *area, uint32_t mtu, const std::vector<LSA::Header>& headers) {
+    ExchangeResult result;
+    Loopback loop;
+    if (!open_loopback(loop, area, mtu)) {
+        return result;
+    }
+    auto nbr = loop.nbr;
+    auto peer_ip = nbr->ip_addr;
+    // 进入Full时重新生成的Router-LSA按广播网络描述接口，本路由器作为DR
+    loop.intf->type = Interface::Type::BROADCAST;
+    loop.intf->state = Interface::State::DR;
+    loop.intf->designated_router = loop.intf->ip_addr;
+    nbr->designated_router = loop.intf->ip_addr;
+    auto per_packet = (mtu - sizeof(iphdr) - sizeof(OSPF::Header) - sizeof(OSPF::DD)) / sizeof(LSA::Header);
+    std::vector<char> buf(mtu);
+    uint32_t seq = 1000;
+    size_t sent = 0;
+
+    auto start = Clock::now();
+    {
+        Quiet quiet;
+        nbr->event_2way_received();
+        do {
+            // 第一个DD只用于协商主从
+            auto first = result.rounds == 0;
+            auto num = first ? 0 : std::min(per_packet, headers.size() - sent);
+            uint8_t flags = DD_FLAG_MS;
+            if (first) {
+                flags |= DD_FLAG_I | DD_FLAG_M;
+            } else if (sent + num < headers.size()) {
+                flags |= DD_FLAG_M;
+            }
+
+            // 接收路径交给process_dd的OSPF头部已是主机字节序
+            auto hdr = reinterpret_cast<OSPF::Header *>(buf.data());
+            memset(hdr, 0, sizeof(OSPF::Header));
+            hdr->version = OSPF_VERSION;
+            hdr->type = OSPF::Type::DD;
+            hdr->length = sizeof(OSPF::Header) + sizeof(OSPF::DD) + num * sizeof(LSA::Header);
+            hdr->router_id = nbr->id;
+            hdr->area_id = area->area_id;
+            auto dd = reinterpret_cast<OSPF::DD *>(buf.data() + sizeof(OSPF::Header));
+            dd->interface_mtu = htons(mtu);
+            dd->options = 0x02;
+            dd->flags = flags;
+            dd->sequence_number = htonl(seq++);
+            memcpy(dd->lsahdrs, headers.data() + sent, num * sizeof(LSA::Header));
+            sent += num;
+
+            OSPF::process_dd(loop.intf, buf.data(), peer_ip);
+            result.rounds++;
+        } while (nbr->state == Neighbor::State::EXCHANGE && result.rounds < 10 * headers.size() + 10);
+    }
+    result.cpu_ms = elapsed_ms(start);
+    result.full = nbr->state == Neighbor::State::FULL;
+    close_loopback(loop);
+    return result;
+}
+
+int run_exchange(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {1000, 10000, 50000});
+    std::cout << "Database exchange as slave (est = rounds x " << RTT_MS << " ms RTT + cpu)" << std::endl
+              << "routers    lsas   mtu  hdrs/dd  rounds     cpu_ms      est_ms  full" << std::endl;
+    int failures = 0;
+    for (auto size : sizes) {
+        auto area = new Area(0);
+        build_grid(area, size);
+        auto headers = summary_headers(area);
+        for (auto mtu : MTUS) {
+            auto result = exchange(area, mtu, headers);
+            auto per_dd = (mtu - sizeof(iphdr) - sizeof(OSPF::Header) - sizeof(OSPF::DD)) / sizeof(LSA::Header);
+            std::cout << std::setw(7) << size << std::setw(8) << headers.size() << std::setw(6) << mtu
+                      << std::setw(9) << per_dd << std::setw(8) << result.rounds << std::fixed << std::setprecision(2)
+                      << std::setw(11) << result.cpu_ms << std::setw(12) << result.rounds * RTT_MS + result.cpu_ms
+                      << std::setw(6) << (result.full ? "yes" : "no") << std::endl;
+            failures += !result.full;
+        }
+        delete area;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+/*
+ * 向一个Full的邻接洪泛整个数据库：
+ * - 逐条发送（flood_delay_ms为0）与合并到MTU大小的LSU比较；
+ * - 报文经原始套接字发往本机，计入sendto的开销。
+ */
+int run_lsu(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {1000, 10000});
+    std::cout << "Flooding the whole LSDB to one adjacency" << std::endl
+              << "   lsas   mtu  batched  packets  lsas/pkt         ms" << std::endl;
+    auto saved_delay = OSPF::flood_delay_ms;
+    int failures = 0;
+    for (auto size : sizes) {
+        auto area = new Area(0);
+        build_grid(area, size);
+        area->lsdb.lock();
+        auto snapshot = area->lsdb.snapshot();
+        area->lsdb.unlock();
+        std::vector<LSA::Base *> lsas;
+        for (auto& lsa : *snapshot->router_lsas) {
+            lsas.push_back(lsa.get());
+        }
+        for (auto& lsa : *snapshot->network_lsas) {
+            lsas.push_back(lsa.get());
+        }
+
+        for (auto mtu : {1500u, 9000u}) {
+            for (auto batched : {false, true}) {
+                Loopback loop;
+                if (!open_loopback(loop, area, mtu)) {
+                    failures++;
+                    continue;
+                }
+                loop.nbr->state = Neighbor::State::FULL;
+                OSPF::flood_delay_ms = batched ? 10 : 0;
+
+                auto start = Clock::now();
+                for (auto lsa : lsas) {
+                    OSPF::flood_lsa(area, lsa);
+                }
+                OSPF::flush_flood(area);
+                auto ms = elapsed_ms(start);
+
+                auto packets = loop.intf->tx_lsu_packets;
+                std::cout << std::setw(7) << lsas.size() << std::setw(6) << mtu << std::setw(9)
+                          << (batched ? "yes" : "no") << std::setw(9) << packets << std::fixed << std::setprecision(2)
+                          << std::setw(10) << double(loop.intf->tx_lsu_lsas) / std::max<uint64_t>(packets, 1)
+                          << std::setw(11) << ms << std::endl;
+                failures += loop.intf->tx_lsu_lsas != lsas.size() || loop.nbr->rxmt_outstanding() != lsas.size();
+                close_loopback(loop);
+            }
+        }
+        snapshot.reset();
+        delete area;
+    }
+    OSPF::flood_delay_ms = saved_delay;
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace Bench
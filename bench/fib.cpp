@@ -0,0 +1,105 @@
+#include <iomanip>
+#include <iostream>
+#include <unordered_set>
+
+#include "bench.hpp"
+#include "fib.hpp"
+
+namespace Bench {
+
+struct Prefix {
+    in_addr_t prefix;
+    uint8_t len;
+};
+
+static in_addr_t len_mask(uint8_t len) {
+    return len == 0 ? 0 : ~0u << (32 - len);
+}
+
+/* n个互不相同的前缀，长度大致按互联网路由表分布：多数为/24，其余分布在/8到/32，另有一条默认路由 */
+static std::vector<Prefix> make_prefixes(size_t n, Rand& rand) {
+    std::vector<Prefix> prefixes = {{0, 0}};
+    std::unordered_set<uint64_t> seen = {0};
+    while (prefixes.size() < n) {
+        auto pick = rand.below(100);
+        uint8_t len = pick < 60   ? 24
+                      : pick < 85 ? 16 + rand.below(8)
+                      : pick < 95 ? 25 + rand.below(8)
+                                  : 8 + rand.below(8);
+        auto prefix = rand.next() & len_mask(len);
+        if (seen.insert(static_cast<uint64_t>(prefix) << 8 | len).second) {
+            prefixes.push_back({prefix, len});
+        }
+    }
+    return prefixes;
+}
+
+/* 逐个比较的最长前缀匹配，返回前缀的下标加一，没有匹配时为0 */
+static in_addr_t scan(const std::vector<Prefix>& prefixes, in_addr_t addr) {
+    int best_len = -1;
+    in_addr_t best = 0;
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+        auto& p = prefixes[i];
+        if (p.len > best_len && ((addr ^ p.prefix) & len_mask(p.len)) == 0) {
+            best_len = p.len;
+            best = i + 1;
+        }
+    }
+    return best;
+}
+
+/*
+ * PrefixTrie的构建时间和单线程查找速率，与逐个比较前缀的线性查找（原lookup_route的做法）比较，
+ * 并以线性查找的结果校验一部分地址。
+ */
+int run_fib(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {1000, 10000, 500000});
+    constexpr size_t LOOKUPS = 1000000;
+    std::cout << "Longest-prefix match (lookups/s, single thread)" << std::endl
+              << "prefixes  build_ms       trie       scan  checked  mismatches" << std::endl;
+    int failures = 0;
+    for (auto size : sizes) {
+        Rand rand;
+        auto prefixes = make_prefixes(size, rand);
+
+        auto start = Clock::now();
+        PrefixTrie trie;
+        for (size_t i = 0; i < prefixes.size(); ++i) {
+            // 下一跳记为前缀的下标加一，用于与线性查找比对
+            trie.insert(prefixes[i].prefix, len_mask(prefixes[i].len), {i + 1, nullptr});
+        }
+        auto build_ms = elapsed_ms(start);
+
+        // 一半落在某个前缀之内（主机位随机），一半完全随机
+        std::vector<in_addr_t> addrs(LOOKUPS);
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            auto& p = prefixes[rand.below(prefixes.size())];
+            addrs[i] = i % 2 == 0 ? p.prefix | (rand.next() & ~len_mask(p.len)) : rand.next();
+        }
+
+        volatile in_addr_t sink = 0;
+        start = Clock::now();
+        for (auto addr : addrs) {
+            sink = sink + trie.lookup(addr).first;
+        }
+        auto trie_rate = LOOKUPS / (elapsed_ms(start) / 1000);
+
+        // 线性查找代价与前缀数成正比，校验的地址数相应减少
+        auto checked = std::max<size_t>(200, std::min<size_t>(20000, 200000000 / prefixes.size()));
+        size_t mismatches = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < checked; ++i) {
+            auto expect = scan(prefixes, addrs[i]);
+            mismatches += trie.lookup(addrs[i]).first != expect;
+        }
+        auto scan_rate = checked / (elapsed_ms(start) / 1000);
+
+        std::cout << std::setw(8) << trie.size() << std::fixed << std::setprecision(2) << std::setw(10) << build_ms
+                  << std::setprecision(0) << std::setw(11) << trie_rate << std::setw(11) << scan_rate << std::setw(9)
+                  << checked << std::setw(12) << mismatches << std::endl;
+        failures += mismatches != 0 || trie.size() != prefixes.size();
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace Bench
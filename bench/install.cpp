@@ -0,0 +1,172 @@
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <net/route.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "netlink.hpp"
+
+namespace Bench {
+
+// 路由的目的为10.0.0.0起的/32，经由回环直连
+constexpr in_addr_t BASE = 0x0a000000;
+constexpr uint32_t METRIC = 20;
+
+/* dump主表，统计protocol为proto的路由数，失败时返回-1 */
+static long count_routes(uint8_t proto) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        perror("count_routes: socket");
+        return -1;
+    }
+    struct {
+        nlmsghdr nlh;
+        rtmsg rtm;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(rtmsg));
+    req.nlh.nlmsg_type = RTM_GETROUTE;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.rtm.rtm_family = AF_INET;
+    if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+        perror("count_routes: send");
+        close(fd);
+        return -1;
+    }
+    long count = 0;
+    static char rbuf[64 * 1024];
+    bool done = false;
+    while (!done) {
+        auto len = recv(fd, rbuf, sizeof(rbuf), 0);
+        if (len < 0) {
+            perror("count_routes: recv");
+            count = -1;
+            break;
+        }
+        for (auto nlh = (nlmsghdr *)rbuf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_DONE || nlh->nlmsg_type == NLMSG_ERROR) {
+                done = true;
+                break;
+            }
+            auto rtm = (rtmsg *)NLMSG_DATA(nlh);
+            count += rtm->rtm_protocol == proto && rtm->rtm_table == RT_TABLE_MAIN;
+        }
+    }
+    close(fd);
+    return count;
+}
+
+/* 退回ioctl时的写法：每条路由一次系统调用，protocol由内核记为RTPROT_BOOT */
+static bool ioctl_route(int fd, unsigned long request, in_addr_t dst) {
+    rtentry rtentry;
+    memset(&rtentry, 0, sizeof(rtentry));
+    rtentry.rt_dst.sa_family = AF_INET;
+    ((sockaddr_in *)&rtentry.rt_dst)->sin_addr.s_addr = htonl(dst);
+    rtentry.rt_genmask.sa_family = AF_INET;
+    ((sockaddr_in *)&rtentry.rt_genmask)->sin_addr.s_addr = htonl(0xffffffff);
+    rtentry.rt_gateway.sa_family = AF_INET;
+    rtentry.rt_metric = METRIC;
+    rtentry.rt_flags = RTF_UP | RTF_HOST;
+    char dev[IFNAMSIZ] = "lo";
+    rtentry.rt_dev = dev;
+    return ioctl(fd, request, &rtentry) == 0;
+}
+
+struct InstallResult {
+    double add_ms = -1;
+    double del_ms = -1;
+    long installed = -1;
+    long left = -1;
+    size_t failed = 0;
+};
+
+static InstallResult install_ioctl(size_t n) {
+    InstallResult result;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("install_ioctl: socket");
+        return result;
+    }
+    // 命名空间中由ip route添加的路由同样是RTPROT_BOOT
+    auto existing = count_routes(RTPROT_BOOT);
+    auto start = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        result.failed += !ioctl_route(fd, SIOCADDRT, BASE + i);
+    }
+    result.add_ms = elapsed_ms(start);
+    result.installed = count_routes(RTPROT_BOOT) - existing;
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        ioctl_route(fd, SIOCDELRT, BASE + i);
+    }
+    result.del_ms = elapsed_ms(start);
+    result.left = count_routes(RTPROT_BOOT) - existing;
+    close(fd);
+    return result;
+}
+
+/* batch为每次flush之间的路由数 */
+static InstallResult install_netlink(size_t n, size_t batch) {
+    InstallResult result;
+    NetlinkRoute netlink;
+    if (!netlink.open()) {
+        return result;
+    }
+    std::vector<NetlinkRoute::Nexthop> nexthops = {{0, static_cast<int>(if_nametoindex("lo"))}};
+    auto start = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        netlink.add(BASE + i, 0xffffffff, nexthops, METRIC, i);
+        if ((i + 1) % batch == 0) {
+            result.failed += netlink.flush().size();
+        }
+    }
+    result.failed += netlink.flush().size();
+    result.add_ms = elapsed_ms(start);
+    result.installed = count_routes(RTPROT_OSPF);
+    start = Clock::now();
+    {
+        Quiet quiet;
+        netlink.purge();
+    }
+    result.del_ms = elapsed_ms(start);
+    result.left = count_routes(RTPROT_OSPF);
+    return result;
+}
+
+/*
+ * 向内核写入n条路由再全部删除，比较：
+ * - ioctl逐条写入（netlink不可用时的退路）；
+ * - netlink每条消息单独发出；
+ * - netlink批量发出（NetlinkRoute的默认用法），删除时dump后批量删除。
+ * 会修改路由表，由bench.sh在独立的网络命名空间中运行。
+ */
+int run_install(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {10000, 100000});
+    std::cout << "Kernel route install (/32 via lo)" << std::endl
+              << " routes backend          add_ms  routes/s     del_ms  installed  left  failed" << std::endl;
+    int failures = 0;
+    for (auto size : sizes) {
+        auto report = [&](const char *name, const InstallResult& result) {
+            std::cout << std::setw(7) << size << " " << std::left << std::setw(15) << name << std::right << std::fixed
+                      << std::setprecision(2) << std::setw(10) << result.add_ms << std::setw(10)
+                      << std::setprecision(0) << size / (result.add_ms / 1000) << std::setprecision(2)
+                      << std::setw(11) << result.del_ms << std::setw(11) << result.installed << std::setw(6)
+                      << result.left << std::setw(8) << result.failed << std::endl;
+            failures += result.installed != long(size) || result.left != 0 || result.failed != 0;
+        };
+        report("ioctl", install_ioctl(size));
+        report("netlink/single", install_netlink(size, 1));
+        report("netlink/batch", install_netlink(size, SIZE_MAX));
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace Bench
@@ -0,0 +1,182 @@
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+
+#include "bench.hpp"
+#include "interface.hpp"
+#include "neighbor.hpp"
+
+namespace Bench {
+
+/* n条彼此独立的Router-LSA，各带一条点对点链路和一个存根网络，年龄为age */
+static void install_flat(Area *area, size_t n, uint16_t age) {
+    for (size_t i = 0; i < n; ++i) {
+        auto rid = 0x64000000u + static_cast<in_addr_t>(i) + 1;
+        auto lsa = make_router_lsa(rid, {RouterLSA::Link(rid + 1, 0, LSA::LinkType::POINT2POINT, 1),
+                                         RouterLSA::Link(0x0b000000u + i, 0xffffffff, LSA::LinkType::STUB, 1)});
+        lsa->set_age(age);
+        install(area, lsa);
+    }
+}
+
+/*
+ * 老化的开销：
+ * - 安装的时间和每条LSA占用的内存；
+ * - 没有LSA到期时每秒一次的检查；
+ * - 全部LSA同时到达MaxAge时的清除和删除（没有邻接，清除后当即删除）。
+ */
+int run_aging(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {10000, 100000});
+    constexpr int IDLE_TICKS = 1000;
+    std::cout << "LSDB aging" << std::endl
+              << "   lsas install_ms  bytes/lsa  idle_tick_us   flush_ms  flushed  removed" << std::endl;
+    int failures = 0;
+    for (auto size : sizes) {
+        auto area = new Area(0);
+        auto rss = rss_kb();
+        auto start = Clock::now();
+        install_flat(area, size, 0);
+        auto install_ms = elapsed_ms(start);
+        auto bytes = (rss_kb() - rss) * 1024.0 / size;
+
+        start = Clock::now();
+        for (int i = 0; i < IDLE_TICKS; ++i) {
+            area->lsdb.age_tick();
+        }
+        auto idle_us = elapsed_ms(start) * 1000 / IDLE_TICKS;
+        delete area;
+
+        // 年龄为MaxAge-1，下一秒到期
+        area = new Area(0);
+        install_flat(area, size, LSA::MAX_AGE - 1);
+        auto installed_at = LSA::now_seconds();
+        while (LSA::now_seconds() <= installed_at) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        start = Clock::now();
+        area->lsdb.age_tick();
+        auto flush_ms = elapsed_ms(start);
+        OSPF::flush_flood(area);
+
+        std::cout << std::setw(7) << size << std::fixed << std::setprecision(2) << std::setw(11) << install_ms
+                  << std::setw(11) << bytes << std::setw(14) << idle_us << std::setw(11) << flush_ms << std::setw(9)
+                  << area->lsdb.lsa_flushed << std::setw(9) << area->lsdb.lsa_removed << std::endl;
+        failures += area->lsdb.lsa_flushed != size || area->lsdb.lsa_removed != size || area->lsdb.lsa_num() != 0;
+        delete area;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+/* 把LSA（网络字节序）装入若干LSU报文，OSPF头部按接收路径交给process_lsu时的主机字节序 */
+static std::vector<std::vector<char>> pack_lsus(const std::vector<std::vector<char>>& lsas, uint32_t mtu) {
+    std::vector<std::vector<char>> packets;
+    auto limit = mtu - sizeof(iphdr);
+    std::vector<char> packet;
+    uint32_t num = 0;
+    auto finish = [&]() {
+        auto hdr = reinterpret_cast<OSPF::Header *>(packet.data());
+        memset(hdr, 0, sizeof(OSPF::Header));
+        hdr->version = OSPF_VERSION;
+        hdr->type = OSPF::Type::LSU;
+        hdr->length = packet.size();
+        hdr->router_id = ntohl(inet_addr("2.2.2.2"));
+        reinterpret_cast<OSPF::LSU *>(packet.data() + sizeof(OSPF::Header))->num_lsas = htonl(num);
+        packets.push_back(std::move(packet));
+        packet.clear();
+        num = 0;
+    };
+    for (auto& lsa : lsas) {
+        if (num > 0 && packet.size() + lsa.size() > limit) {
+            finish();
+        }
+        if (packet.empty()) {
+            packet.resize(sizeof(OSPF::Header) + sizeof(OSPF::LSU));
+        }
+        packet.insert(packet.end(), lsa.begin(), lsa.end());
+        num++;
+    }
+    if (num > 0) {
+        finish();
+    }
+    return packets;
+}
+
+/* 序列号加一并重新计算校验和 */
+static std::vector<char> bump_seq(const std::vector<char>& lsa) {
+    auto newer = lsa;
+    auto hdr = reinterpret_cast<LSA::Header *>(newer.data());
+    hdr->sequence_number = htonl(ntohl(hdr->sequence_number) + 1);
+    hdr->checksum = 0;
+    hdr->checksum = htons(fletcher16(newer.data() + 2, newer.size() - 2, 14));
+    return newer;
+}
+
+/*
+ * 从一个Full的邻接收到LSU时，每个报文经过全局operator new的分配次数：
+ * - 新LSA：安装并延迟确认；
+ * - 重复的LSA：直接确认；
+ * - 较新的实例：替换已有的实例。
+ */
+int run_alloc(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {10000});
+    constexpr uint32_t MTU = 1500;
+    std::cout << "Receiving LSUs (mtu " << MTU << ")" << std::endl
+              << "   lsas pass       packets  allocs/pkt  allocs/lsa     us/pkt" << std::endl;
+    int failures = 0;
+    for (auto size : sizes) {
+        // 取网格拓扑中的LSA作为邻居发来的内容
+        auto source = new Area(0);
+        build_grid(source, size);
+        source->lsdb.lock();
+        auto snapshot = source->lsdb.snapshot();
+        source->lsdb.unlock();
+        std::vector<std::vector<char>> lsas, newer;
+        for (auto& lsa : *snapshot->router_lsas) {
+            lsas.emplace_back(lsa->data.begin(), lsa->data.end());
+            newer.push_back(bump_seq(lsas.back()));
+        }
+        snapshot.reset();
+        delete source;
+        auto packets = pack_lsus(lsas, MTU);
+        auto newer_packets = pack_lsus(newer, MTU);
+
+        auto area = new Area(0);
+        Loopback loop;
+        if (!open_loopback(loop, area, MTU)) {
+            delete area;
+            return 1;
+        }
+        loop.nbr->state = Neighbor::State::FULL;
+        std::vector<char> buf(MTU);
+        auto receive = [&](const char *pass, const std::vector<std::vector<char>>& lsus) {
+            uint64_t allocs = 0;
+            double ms = 0;
+            for (auto& lsu : lsus) {
+                // process_lsu原地转换字节序，每次处理一份副本
+                memcpy(buf.data(), lsu.data(), lsu.size());
+                auto before = heap_allocs();
+                auto start = Clock::now();
+                OSPF::process_lsu(loop.intf, buf.data(), loop.nbr->ip_addr);
+                ms += elapsed_ms(start);
+                allocs += heap_allocs() - before;
+            }
+            std::cout << std::setw(7) << lsas.size() << " " << std::left << std::setw(10) << pass << std::right
+                      << std::setw(8) << lsus.size() << std::fixed << std::setprecision(2) << std::setw(12)
+                      << double(allocs) / lsus.size() << std::setw(12) << double(allocs) / lsas.size()
+                      << std::setw(11) << ms * 1000 / lsus.size() << std::endl;
+        };
+        receive("new", packets);
+        receive("duplicate", packets);
+        receive("newer", newer_packets);
+        failures += area->lsdb.lsa_num() != lsas.size();
+        close_loopback(loop);
+        delete area;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace Bench
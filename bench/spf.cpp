@@ -0,0 +1,149 @@
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "bench.hpp"
+#include "workers.hpp"
+
+namespace Bench {
+
+// 全量计算取多次的平均，增量计算每次只改变一台路由器的一条链路
+constexpr int FULL_RUNS = 5;
+constexpr int INCREMENTAL_RUNS = 100;
+constexpr int VERIFY_RUNS = 20;
+constexpr uint32_t MAX_PATHS = 4;
+
+using Builder = std::function<Topology(Area *, size_t)>;
+
+// 返回增量计算与全量计算不一致的次数
+static uint64_t bench_topology(const char *name, const Builder& build, size_t routers) {
+    auto area = new Area(0);
+    auto topo = build(area, routers);
+
+    // 第一次全量计算建立图，不计入
+    area->run_spf(true, false, MAX_PATHS);
+    area->release_snapshot();
+    auto start = Clock::now();
+    for (int i = 0; i < FULL_RUNS; ++i) {
+        area->run_spf(true, false, MAX_PATHS);
+        area->release_snapshot();
+    }
+    auto full_ms = elapsed_ms(start) / FULL_RUNS;
+
+    size_t reachable = 0, ecmp = 0;
+    for (auto& pair : area->nodes) {
+        if (pair.second.dist != UINT32_MAX) {
+            reachable++;
+            ecmp += pair.second.first_hops.size() > 1;
+        }
+    }
+
+    Rand rand;
+    double incremental_ms = 0;
+    for (int i = 0; i < INCREMENTAL_RUNS; ++i) {
+        perturb(area, topo, rand);
+        start = Clock::now();
+        area->run_spf(false, false, MAX_PATHS);
+        incremental_ms += elapsed_ms(start);
+        area->release_snapshot();
+    }
+    incremental_ms /= INCREMENTAL_RUNS;
+
+    // 增量计算的结果与全量计算比对；其中一半先删除一台路由器的存根网络，再以同样的随机数选中它加回，
+    // 回收的编号被新结点复用
+    for (int i = 0; i < VERIFY_RUNS; ++i) {
+        if (i % 2 == 1) {
+            auto replay = rand;
+            perturb(area, topo, rand, true);
+            area->run_spf(false, false, MAX_PATHS);
+            area->release_snapshot();
+            perturb(area, topo, replay, true);
+        } else {
+            perturb(area, topo, rand);
+        }
+        area->run_spf(false, true, MAX_PATHS);
+        area->release_snapshot();
+    }
+
+    std::cout << std::left << std::setw(6) << name << std::right << std::setw(8) << topo.routers.size() + 1
+              << std::setw(8) << topo.lsas << std::setw(8) << reachable << std::setw(8) << ecmp << std::fixed
+              << std::setprecision(2) << std::setw(11) << full_ms << std::setw(11) << incremental_ms << std::setw(9)
+              << area->spf_verify_failures << std::endl;
+    auto failures = area->spf_verify_failures;
+    delete area;
+    return failures;
+}
+
+int run_spf(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {1000, 10000, 50000});
+    std::cout << "SPF (max paths " << MAX_PATHS << ", incremental = one link metric change, avg of "
+              << INCREMENTAL_RUNS << ")" << std::endl
+              << "topo   routers    lsas   nodes    ecmp    full_ms    incr_ms verify_x" << std::endl;
+    uint64_t failures = 0;
+    for (auto size : sizes) {
+        failures += bench_topology("grid", [](Area *area, size_t n) { return build_grid(area, n); }, size);
+    }
+    for (auto size : sizes) {
+        failures += bench_topology("clos", build_clos, size);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// 同样数量的路由器分到k个区域，比较逐个区域计算和在线程池中并行计算
+int run_areas(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {50000});
+    std::cout << "Per-area full SPF, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl
+              << "routers areas  serial_ms    pool_ms  speedup" << std::endl;
+    for (auto size : sizes) {
+        for (size_t k : {1, 2, 4, 8}) {
+            std::vector<Area *> areas;
+            for (size_t i = 0; i < k; ++i) {
+                areas.push_back(new Area(i));
+                build_grid(areas.back(), size / k);
+            }
+            for (auto area : areas) {
+                area->run_spf(true, false, MAX_PATHS);
+                area->release_snapshot();
+            }
+
+            auto start = Clock::now();
+            for (int run = 0; run < FULL_RUNS; ++run) {
+                for (auto area : areas) {
+                    area->run_spf(true, false, MAX_PATHS);
+                    area->release_snapshot();
+                }
+            }
+            auto serial_ms = elapsed_ms(start) / FULL_RUNS;
+
+            // 第一次运行时创建线程，不计入
+            WorkerPool pool;
+            auto run_pool = [&]() {
+                std::vector<WorkerPool::Task> tasks;
+                for (auto area : areas) {
+                    tasks.push_back([area]() { area->run_spf(true, false, MAX_PATHS); });
+                }
+                pool.run(tasks);
+                for (auto area : areas) {
+                    area->release_snapshot();
+                }
+            };
+            run_pool();
+            start = Clock::now();
+            for (int run = 0; run < FULL_RUNS; ++run) {
+                run_pool();
+            }
+            auto pool_ms = elapsed_ms(start) / FULL_RUNS;
+
+            std::cout << std::setw(7) << size << std::setw(6) << k << std::fixed << std::setprecision(2)
+                      << std::setw(11) << serial_ms << std::setw(11) << pool_ms << std::setw(9)
+                      << serial_ms / pool_ms << std::endl;
+            for (auto area : areas) {
+                delete area;
+            }
+        }
+    }
+    return 0;
+}
+
+} // namespace Bench
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "bench.hpp"
+#include "timer.hpp"
+
+namespace Bench {
+
+/*
+ * 时间轮的开销（使用独立的TimerWheel，不影响this_timers）：
+ * - 添加和取消n个定时器，延迟分布在各层；
+ * - run()在另一线程中执行时回调相对预定时刻的延迟。
+ */
+int run_timer(int argc, char *argv[]) {
+    auto sizes = parse_sizes(argc > 0 ? argv[0] : nullptr, {1000000});
+    constexpr size_t FIRED = 2000;
+    std::cout << "Timer wheel" << std::endl
+              << " timers  add_ns  cancel_ns  late_avg_ms  late_p99_ms  late_max_ms" << std::endl;
+    int failures = 0;
+    for (auto size : sizes) {
+        TimerWheel wheel;
+        Rand rand;
+        std::vector<TimerWheel::TimerId> ids(size);
+        // 最长约一小时，与LSA老化和各协议计时器的范围相当
+        std::vector<uint32_t> delays(size);
+        for (auto& delay : delays) {
+            delay = 1000 + rand.below(3600 * 1000);
+        }
+        auto start = Clock::now();
+        for (size_t i = 0; i < size; ++i) {
+            ids[i] = wheel.add(delays[i], [] {});
+        }
+        auto add_ns = elapsed_ms(start) * 1e6 / size;
+        // 按随机顺序取消
+        for (size_t i = size; i > 1; --i) {
+            std::swap(ids[i - 1], ids[rand.below(i)]);
+        }
+        start = Clock::now();
+        size_t cancelled = 0;
+        for (auto id : ids) {
+            cancelled += wheel.cancel(id);
+        }
+        auto cancel_ns = elapsed_ms(start) * 1e6 / size;
+        failures += cancelled != size || wheel.size() != 0;
+
+        // 回调记录实际执行时刻与预定时刻之差
+        std::vector<double> late(FIRED);
+        std::atomic<size_t> fired(0);
+        std::thread runner([&wheel] { wheel.run(); });
+        for (size_t i = 0; i < FIRED; ++i) {
+            auto delay = 1 + rand.below(500);
+            auto due = Clock::now() + std::chrono::milliseconds(delay);
+            wheel.add(delay, [&late, &fired, i, due] {
+                late[i] = std::chrono::duration<double, std::milli>(Clock::now() - due).count();
+                fired++;
+            });
+        }
+        while (fired < FIRED) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        wheel.stop();
+        runner.join();
+
+        std::sort(late.begin(), late.end());
+        double sum = 0;
+        for (auto ms : late) {
+            sum += ms;
+        }
+        std::cout << std::setw(7) << size << std::fixed << std::setprecision(1) << std::setw(8) << add_ns
+                  << std::setw(11) << cancel_ns << std::setprecision(3) << std::setw(13) << sum / FIRED
+                  << std::setw(13) << late[FIRED * 99 / 100] << std::setw(13) << late.back() << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace Bench
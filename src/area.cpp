@@ -0,0 +1,755 @@
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <queue>
+#include <tuple>
+#include <unordered_set>
+
+#include <arpa/inet.h>
+
+#include "area.hpp"
+#include "interface.hpp"
+#include "utils.hpp"
+
+std::vector<Area *> this_areas;
+
+Area *get_area(uint32_t area_id) {
+    for (auto area : this_areas) {
+        if (area->area_id == area_id) {
+            return area;
+        }
+    }
+    auto area = new Area(area_id);
+    this_areas.push_back(area);
+    return area;
+}
+
+bool is_abr() {
+    return this_areas.size() > 1;
+}
+
+std::vector<Area *> summary_areas() {
+    if (is_abr()) {
+        for (auto area : this_areas) {
+            if (area->area_id == 0) {
+                return {area};
+            }
+        }
+    }
+    return this_areas;
+}
+
+Area::Area(uint32_t area_id) : area_id(area_id), lsdb(this) {
+    root_id = ntohl(inet_addr(THIS_ROUTER_ID));
+}
+
+static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+// 在工作线程中执行，不访问其它区域和路由表
+void Area::run_spf(bool full_spf, bool verify_spf, uint32_t max_paths) noexcept {
+    this->max_paths = max_paths;
+    // 根据LSDB的变化记录决定全量、增量还是不必计算
+    std::vector<uint32_t> invalid;
+    std::vector<std::pair<uint32_t, DenseEdge>> relax;
+    std::vector<uint32_t> hop_seeds;
+    auto full = full_spf || !spt_built;
+    // 变化记录和快照在同一次加锁中取得，二者一致；之后的计算不再持有LSDB的锁
+    lsdb.lock();
+    changes = lsdb.take_changes();
+    snapshot = lsdb.snapshot();
+    lsdb.unlock();
+    intra_changed = full || std::any_of(changes.begin(), changes.end(), [](const LSDB::Change& change) {
+                        return change.type == LSA::Type::ROUTER || change.type == LSA::Type::NETWORK;
+                    });
+    if (!intra_changed) {
+        // 只有Summary-LSA变化（rfc2328 16.5），最短路径树保持不变
+        return;
+    }
+    if (full) {
+        build_graph();
+    } else {
+        apply_changes(changes, invalid, relax, hop_seeds);
+    }
+
+    // 执行dijkstra算法，同时求出直接后继
+    if (full) {
+        dijkstra();
+        spt_built = true;
+        spf_full_runs++;
+    } else if (!invalid.empty() || !relax.empty() || !hop_seeds.empty()) {
+        incremental_dijkstra(invalid, relax, hop_seeds);
+        spf_incremental_runs++;
+        if (verify_spf && !verify_spt()) {
+            spf_verify_failures++;
+        }
+    }
+}
+
+// 加入结点并分配编号，已存在时只更新mask，返回结点的编号
+uint32_t Area::add_node(in_addr_t id, in_addr_t mask) noexcept {
+    auto it = nodes.find(id);
+    if (it != nodes.end()) {
+        if (mask != 0) {
+            it->second.mask = mask;
+            dense.masks[it->second.index] = mask;
+        }
+        return it->second.index;
+    }
+    auto& node = nodes[id] = {id, mask, UINT32_MAX};
+    prevs[id] = 0;
+    uint32_t index;
+    if (!dense.free.empty()) {
+        index = dense.free.back();
+        dense.free.pop_back();
+    } else {
+        index = dense.ids.size();
+        dense.ids.push_back(0);
+        dense.nodes.push_back(nullptr);
+        dense.masks.push_back(0);
+        dense.dist.push_back(UINT32_MAX);
+        dense.prev.push_back(NO_INDEX);
+        dense.out.emplace_back();
+        dense.in.emplace_back();
+    }
+    node.index = index;
+    dense.ids[index] = id;
+    dense.nodes[index] = &node;
+    dense.masks[index] = mask;
+    dense.dist[index] = UINT32_MAX;
+    dense.prev[index] = NO_INDEX;
+    return index;
+}
+
+// 删除不再有任何边的结点，回收其编号
+void Area::remove_node(uint32_t index) noexcept {
+    auto id = dense.ids[index];
+    nodes.erase(id);
+    prevs.erase(id);
+    dense.nodes[index] = nullptr;
+    dense.dist[index] = UINT32_MAX;
+    dense.prev[index] = NO_INDEX;
+    dense.free.push_back(index);
+}
+
+// 按LSDB刷新一个网络结点的信息，返回新旧连接的所有路由器
+// 读取lsdb快照，由调用者保证已取得
+std::vector<in_addr_t> Area::set_net_info(in_addr_t ls_id) noexcept {
+    std::vector<in_addr_t> touched;
+    auto it = net_infos.find(ls_id);
+    if (it != net_infos.end()) {
+        for (auto& router_id : it->second.attached) {
+            auto& nets = attached_nets[router_id];
+            nets.erase(std::remove(nets.begin(), nets.end(), ls_id), nets.end());
+            touched.push_back(router_id);
+        }
+        net_infos.erase(it);
+    }
+
+    auto nlsa = snapshot->get_network_lsa(ls_id);
+    if (nlsa != nullptr) {
+        // 对网络结点，id本来是dr的接口ip，可能与路由器id相同
+        // 因此这里将网络结点的id按位与其mask，并用mask区分是否是网络结点
+        NetInfo info;
+        auto routers = nlsa->attached_routers();
+        info.node_id = ls_id & nlsa->network_mask();
+        info.attached.assign(routers.begin(), routers.end());
+        add_node(info.node_id, nlsa->network_mask());
+        for (auto& router_id : info.attached) {
+            add_node(router_id, 0);
+            attached_nets[router_id].push_back(ls_id);
+            touched.push_back(router_id);
+        }
+        net_infos[ls_id] = std::move(info);
+    }
+    return touched;
+}
+
+// 按LSDB重建一个路由器结点的出边，同时更新按编号的出边和入边
+// 若invalid/relax/hop_seeds非空，则与旧的出边比较：
+// - 变长或删除的树边，其终点的子树需要失效，记入invalid；
+// - 变短或新增的边，记入relax；
+// - 出边有任何变化时，新旧出边的终点都记入hop_seeds，其直接后继需要重新求出；
+//   起点本身也记入，使失去所有边的结点能被回收。
+// 读取lsdb快照，由调用者保证已取得
+void Area::rebuild_edges(in_addr_t rid, std::vector<uint32_t> *invalid,
+                         std::vector<std::pair<uint32_t, DenseEdge>> *relax, std::vector<uint32_t> *hop_seeds) noexcept {
+    std::vector<DenseEdge> out;
+    auto link_to = [&](in_addr_t dst, in_addr_t mask, uint32_t metric, in_addr_t via) {
+        out.push_back({add_node(dst, mask), metric, via});
+    };
+
+    // 清除旧的TRANSIT引用
+    for (auto& ls_id : transit_links[rid]) {
+        auto& refs = transit_refs[ls_id];
+        refs.erase(std::remove(refs.begin(), refs.end(), rid), refs.end());
+    }
+    transit_links[rid].clear();
+
+    auto lsa = snapshot->get_router_lsa(rid);
+    if (lsa == nullptr && attached_nets[rid].empty() && nodes.find(rid) == nodes.end()) {
+        // 已经回收的结点不必重新加入
+        return;
+    }
+    // 对路由器结点，ls_id为其路由器id
+    auto u = add_node(rid, 0);
+    if (lsa != nullptr) {
+        for (auto link : lsa->links()) {
+            if (link.type == LSA::LinkType::POINT2POINT) {
+                // 对点到点网络，link_id为对端路由器id
+                link_to(link.link_id, 0, link.metric, link.link_data);
+            } else if (link.type == LSA::LinkType::TRANSIT) {
+                // 对中转网络，link_id为该网络dr的接口ip
+                // 因此需要查Network LSA找到所有对应的网络结点
+                transit_links[rid].push_back(link.link_id);
+                transit_refs[link.link_id].push_back(rid);
+                auto nlsa = snapshot->get_network_lsa(link.link_id);
+                if (nlsa == nullptr) {
+                    continue;
+                }
+                for (auto router_id : nlsa->attached_routers()) {
+                    if (router_id == rid) {
+                        continue;
+                    }
+                    link_to(router_id, 0, link.metric, link.link_data);
+                }
+            } else if (link.type == LSA::LinkType::STUB) {
+                // 对stub网络，link_id为网络ip，link_data为mask
+                // 需要新建一个结点
+                link_to(link.link_id, link.link_data, link.metric, 0);
+            } else {
+                // TODO: 暂时不考虑虚拟链路
+            }
+        }
+    }
+    // 路由器到网络结点的边，距离为0
+    for (auto& ls_id : attached_nets[rid]) {
+        link_to(net_infos[ls_id].node_id, 0, 0, 0);
+    }
+
+    auto& old = dense.out[u];
+    if (invalid != nullptr && relax != nullptr) {
+        // 同一终点可能有多条边，只比较最小的度量：按终点编号排序，同一终点只保留第一条
+        auto min_metrics = [](std::vector<DenseEdge> list) {
+            std::sort(list.begin(), list.end(), [](const DenseEdge& a, const DenseEdge& b) {
+                return a.to != b.to ? a.to < b.to : a.metric < b.metric;
+            });
+            list.erase(std::unique(list.begin(), list.end(),
+                                   [](const DenseEdge& a, const DenseEdge& b) { return a.to == b.to; }),
+                       list.end());
+            return list;
+        };
+        auto old_metrics = min_metrics(old);
+        auto new_metrics = min_metrics(out);
+        auto a = old_metrics.begin(), b = new_metrics.begin();
+        while (a != old_metrics.end() || b != new_metrics.end()) {
+            if (b == new_metrics.end() || (a != old_metrics.end() && a->to < b->to)) {
+                // 删除的边
+                if (dense.prev[a->to] == u) {
+                    invalid->push_back(a->to);
+                }
+                ++a;
+            } else if (a == old_metrics.end() || b->to < a->to) {
+                // 新增的边
+                relax->push_back({u, *b});
+                ++b;
+            } else {
+                if (b->metric > a->metric && dense.prev[a->to] == u) {
+                    invalid->push_back(a->to);
+                } else if (b->metric < a->metric) {
+                    relax->push_back({u, *b});
+                }
+                ++a;
+                ++b;
+            }
+        }
+    }
+
+    if (hop_seeds != nullptr && old != out) {
+        for (auto& edge : old) {
+            hop_seeds->push_back(edge.to);
+        }
+        for (auto& edge : out) {
+            hop_seeds->push_back(edge.to);
+        }
+        hop_seeds->push_back(u);
+    }
+
+    // 更新入边
+    for (auto& edge : old) {
+        auto& in = dense.in[edge.to];
+        in.erase(std::remove_if(in.begin(), in.end(), [u](const DenseEdge& e) { return e.to == u; }), in.end());
+    }
+    for (auto& edge : out) {
+        dense.in[edge.to].push_back({u, edge.metric, edge.via});
+    }
+    old = std::move(out);
+}
+
+// 从第一类和第二类LSA中重建整个图
+// 读取lsdb快照，由调用者保证已取得
+void Area::build_graph() noexcept {
+    nodes.clear();
+    prevs.clear();
+    net_infos.clear();
+    attached_nets.clear();
+    transit_links.clear();
+    transit_refs.clear();
+    // 编号重新从0分配；各结点的出边和入边也一并释放，重新分配时在内存中按编号的顺序排列
+    dense.ids.clear();
+    dense.nodes.clear();
+    dense.masks.clear();
+    dense.dist.clear();
+    dense.prev.clear();
+    dense.out.clear();
+    dense.in.clear();
+    dense.free.clear();
+
+    add_node(root_id, 0);
+    for (auto& lsa : *snapshot->network_lsas) {
+        set_net_info(lsa->header.link_state_id);
+    }
+
+    std::vector<in_addr_t> routers;
+    std::unordered_set<in_addr_t> seen;
+    for (auto& lsa : *snapshot->router_lsas) {
+        if (seen.insert(lsa->header.link_state_id).second) {
+            routers.push_back(lsa->header.link_state_id);
+        }
+    }
+    for (auto& pair : attached_nets) {
+        if (seen.insert(pair.first).second) {
+            routers.push_back(pair.first);
+        }
+    }
+    for (auto& router_id : routers) {
+        rebuild_edges(router_id, nullptr, nullptr, nullptr);
+    }
+}
+
+// 将LSDB的变化应用到图上，只重建受影响的路由器的出边
+// 读取lsdb快照，由调用者保证已取得
+bool Area::apply_changes(const std::vector<LSDB::Change>& changes, std::vector<uint32_t>& invalid,
+                         std::vector<std::pair<uint32_t, DenseEdge>>& relax, std::vector<uint32_t>& hop_seeds) noexcept {
+    std::vector<in_addr_t> sources;
+    std::unordered_set<in_addr_t> seen;
+    for (auto& change : changes) {
+        if (change.type == LSA::Type::ROUTER) {
+            if (seen.insert(change.ls_id).second) {
+                sources.push_back(change.ls_id);
+            }
+        } else if (change.type == LSA::Type::NETWORK) {
+            // 网络的变化影响新旧连接的路由器，以及通过TRANSIT链路引用它的路由器
+            for (auto& router_id : set_net_info(change.ls_id)) {
+                if (seen.insert(router_id).second) {
+                    sources.push_back(router_id);
+                }
+            }
+            for (auto& router_id : transit_refs[change.ls_id]) {
+                if (seen.insert(router_id).second) {
+                    sources.push_back(router_id);
+                }
+            }
+        }
+    }
+    for (auto& router_id : sources) {
+        rebuild_edges(router_id, &invalid, &relax, &hop_seeds);
+    }
+    return !sources.empty();
+}
+
+// 单调的基数堆：dijkstra弹出的距离不减，键按与上一次弹出的键的最高不同位分桶，
+// 弹出时最多把一个桶重新分配到更低的桶中，每个元素至多移动32次
+// 链路度量最大为65535，Dial桶需要按距离逐个扫描空桶，在度量较大的拓扑上并不占优
+class RadixHeap {
+public:
+    void push(uint32_t key, uint32_t value) {
+        buckets[bucket_of(key)].emplace_back(key, value);
+        size++;
+    }
+    bool empty() const {
+        return size == 0;
+    }
+    std::pair<uint32_t, uint32_t> pop() {
+        if (buckets[0].empty()) {
+            auto i = 1;
+            while (buckets[i].empty()) {
+                ++i;
+            }
+            auto& bucket = buckets[i];
+            last = UINT32_MAX;
+            for (auto& item : bucket) {
+                last = std::min(last, item.first);
+            }
+            for (auto& item : bucket) {
+                buckets[bucket_of(item.first)].push_back(item);
+            }
+            bucket.clear();
+        }
+        auto item = buckets[0].back();
+        buckets[0].pop_back();
+        size--;
+        return item;
+    }
+
+private:
+    std::vector<std::pair<uint32_t, uint32_t>> buckets[33];
+    uint32_t last = 0;
+    size_t size = 0;
+
+    size_t bucket_of(uint32_t key) const {
+        return key == last ? 0 : 32 - __builtin_clz(key ^ last);
+    }
+};
+
+void Area::dijkstra() noexcept {
+    auto n = dense.ids.size();
+    auto& dist = dense.dist;
+    auto& prev = dense.prev;
+    dist.assign(n, UINT32_MAX);
+    prev.assign(n, NO_INDEX);
+    auto k = (size_t)max_paths;
+    auto& hops = dense.hops;
+    auto& hop_counts = dense.hop_counts;
+    hops.resize(n * k);
+    hop_counts.assign(n, 0);
+
+    // 将一组直接后继并入结点v，保持有序去重，最多保留k个
+    std::vector<Hop> merged;
+    auto merge_hops = [&](uint32_t v, const Hop *from, size_t count) {
+        auto to = &hops[v * k];
+        if (hop_counts[v] == 0) {
+            count = std::min(count, k);
+            std::copy(from, from + count, to);
+            hop_counts[v] = count;
+            return;
+        }
+        merged.clear();
+        std::set_union(to, to + hop_counts[v], from, from + count, std::back_inserter(merged));
+        hop_counts[v] = std::min(merged.size(), k);
+        std::copy(merged.begin(), merged.begin() + hop_counts[v], to);
+    };
+
+    // 初始化根节点
+    auto root = nodes[root_id].index;
+    dist[root] = 0;
+    RadixHeap heap;
+    heap.push(0, root);
+
+    // 计算最短路径，松弛时同时求直接后继（rfc2328 16.1.1）：
+    // 根的直接后继是路由器本身和所经的本端接口，与根直连的网络没有直接后继，其余结点继承前驱的直接后继；
+    // 只有路由器有出边，且路由器之间的度量不为0，因此结点弹出时其直接后继已经完整
+    while (!heap.empty()) {
+        auto top = heap.pop();
+        auto u = top.second;
+        if (top.first != dist[u]) {
+            continue;
+        }
+        for (auto& edge : dense.out[u]) {
+            auto v = edge.to;
+            auto d = top.first + edge.metric;
+            if (d > dist[v]) {
+                continue;
+            }
+            if (d < dist[v]) {
+                dist[v] = d;
+                hop_counts[v] = 0;
+                heap.push(d, v);
+            }
+            if (u != root) {
+                merge_hops(v, &hops[u * k], hop_counts[u]);
+            } else if (dense.masks[v] == 0) {
+                Hop hop{dense.ids[v], edge.via};
+                merge_hops(v, &hop, 1);
+            }
+        }
+    }
+
+    // 等价路径中统一选择id最小的前驱，使全量和增量的结果一致
+    for (uint32_t u = 0; u < n; ++u) {
+        if (dist[u] == UINT32_MAX) {
+            continue;
+        }
+        for (auto& edge : dense.out[u]) {
+            auto v = edge.to;
+            if (v == root || dist[u] + edge.metric != dist[v]) {
+                continue;
+            }
+            if (prev[v] == NO_INDEX || dense.ids[u] < dense.ids[prev[v]]) {
+                prev[v] = u;
+            }
+        }
+    }
+
+    // 写回结果
+    for (uint32_t i = 0; i < n; ++i) {
+        auto node = dense.nodes[i];
+        if (node == nullptr) {
+            continue;
+        }
+        node->dist = dist[i];
+        prevs[node->id] = prev[i] == NO_INDEX ? 0 : dense.ids[prev[i]];
+        node->first_hops.assign(&hops[i * k], &hops[i * k] + hop_counts[i]);
+    }
+}
+
+// 增量dijkstra：
+// 1. 使invalid中结点为根的子树失效；
+// 2. 从未失效结点的入边重新接入失效结点，并加入变短/新增的边；
+// 3. 只从这些结点继续dijkstra；
+// 4. 从距离或入边变化的结点开始更新前驱和直接后继；
+// 5. 只把这些结点的结果写回nodes和prevs。
+void Area::incremental_dijkstra(const std::vector<uint32_t>& invalid,
+                                const std::vector<std::pair<uint32_t, DenseEdge>>& relax,
+                                const std::vector<uint32_t>& hop_seeds) noexcept {
+    auto n = dense.ids.size();
+    auto& dist = dense.dist;
+    auto& prev = dense.prev;
+    RadixHeap heap;
+    // 距离发生变化的结点
+    std::vector<uint32_t> changed;
+    dense.changed.reset(n);
+    auto set_dist = [&](uint32_t v, uint32_t d) {
+        if (dense.changed.insert(v)) {
+            changed.push_back(v);
+        }
+        dist[v] = d;
+    };
+
+    // 失效子树
+    std::vector<uint32_t> affected;
+    dense.affected.reset(n);
+    std::vector<uint32_t> stack(invalid);
+    while (!stack.empty()) {
+        auto u = stack.back();
+        stack.pop_back();
+        if (!dense.affected.insert(u)) {
+            continue;
+        }
+        affected.push_back(u);
+        for (auto& edge : dense.out[u]) {
+            if (prev[edge.to] == u) {
+                stack.push_back(edge.to);
+            }
+        }
+    }
+    for (auto v : affected) {
+        set_dist(v, UINT32_MAX);
+        prev[v] = NO_INDEX;
+    }
+
+    // 从未失效的结点重新接入
+    for (auto v : affected) {
+        for (auto& edge : dense.in[v]) {
+            auto u = edge.to;
+            if (dense.affected.count(u) || dist[u] == UINT32_MAX) {
+                continue;
+            }
+            if (dist[u] + edge.metric < dist[v]) {
+                set_dist(v, dist[u] + edge.metric);
+                prev[v] = u;
+            }
+        }
+        if (dist[v] != UINT32_MAX) {
+            heap.push(dist[v], v);
+        }
+    }
+
+    // 变短或新增的边
+    for (auto& pair : relax) {
+        auto u = pair.first;
+        auto v = pair.second.to;
+        if (dist[u] == UINT32_MAX) {
+            continue;
+        }
+        if (dist[u] + pair.second.metric < dist[v]) {
+            set_dist(v, dist[u] + pair.second.metric);
+            prev[v] = u;
+            heap.push(dist[v], v);
+        }
+    }
+
+    while (!heap.empty()) {
+        auto top = heap.pop();
+        auto u = top.second;
+        if (top.first != dist[u]) {
+            continue;
+        }
+        for (auto& edge : dense.out[u]) {
+            if (dist[edge.to] > top.first + edge.metric) {
+                set_dist(edge.to, top.first + edge.metric);
+                prev[edge.to] = u;
+                heap.push(dist[edge.to], edge.to);
+            }
+        }
+    }
+
+    // 重新选择前驱：距离变化的结点（包括失效的结点）、它们的后继以及边发生变化的终点
+    std::vector<uint32_t> touched;
+    dense.touched.reset(n);
+    auto touch = [&](uint32_t v) {
+        if (dense.touched.insert(v)) {
+            touched.push_back(v);
+        }
+    };
+    for (auto v : changed) {
+        touch(v);
+        for (auto& edge : dense.out[v]) {
+            touch(edge.to);
+        }
+    }
+    for (auto& pair : relax) {
+        touch(pair.second.to);
+    }
+    for (auto v : hop_seeds) {
+        touch(v);
+    }
+    for (auto v : touched) {
+        prev[v] = canonical_prev(v);
+    }
+    update_first_hops(touched);
+
+    // 写回结果，并回收不再被引用的不可达结点
+    for (auto v : touched) {
+        auto node = dense.nodes[v];
+        if (node == nullptr) {
+            continue;
+        }
+        if (node->id != root_id && dist[v] == UINT32_MAX && dense.in[v].empty() &&
+            dense.out[v].empty()) {
+            remove_node(v);
+            continue;
+        }
+        node->dist = dist[v];
+        prevs[node->id] = prev[v] == NO_INDEX ? 0 : dense.ids[prev[v]];
+    }
+}
+
+// 在所有最短入边中选择id最小的起点作为前驱，返回其编号
+uint32_t Area::canonical_prev(uint32_t v) noexcept {
+    auto& dist = dense.dist;
+    if (dense.ids[v] == root_id || dist[v] == UINT32_MAX) {
+        return NO_INDEX;
+    }
+    auto prev = NO_INDEX;
+    for (auto& edge : dense.in[v]) {
+        auto u = edge.to;
+        if (dist[u] == UINT32_MAX || dist[u] + edge.metric != dist[v]) {
+            continue;
+        }
+        if (prev == NO_INDEX || dense.ids[u] < dense.ids[prev]) {
+            prev = u;
+        }
+    }
+    return prev;
+}
+
+std::vector<Area::Edge> Area::out_edges(in_addr_t id) const noexcept {
+    std::vector<Edge> out;
+    auto it = nodes.find(id);
+    if (it != nodes.end()) {
+        for (auto& edge : dense.out[it->second.index]) {
+            out.emplace_back(dense.ids[edge.to], edge.metric, edge.via);
+        }
+    }
+    return out;
+}
+
+// 以全量计算的结果校验增量计算，返回是否一致
+// 校验后保留全量计算的结果
+bool Area::verify_spt() noexcept {
+    auto inc_nodes = nodes;
+    auto inc_prevs = prevs;
+
+    build_graph();
+    dijkstra();
+
+    auto mismatches = 0;
+    auto check = [&](in_addr_t id) {
+        auto a = inc_nodes.find(id);
+        auto b = nodes.find(id);
+        auto a_dist = a == inc_nodes.end() ? UINT32_MAX : a->second.dist;
+        auto b_dist = b == nodes.end() ? UINT32_MAX : b->second.dist;
+        if (a_dist == UINT32_MAX && b_dist == UINT32_MAX) {
+            return;
+        }
+        auto same_hops = a == inc_nodes.end() || b == nodes.end() || a->second.first_hops == b->second.first_hops;
+        if (a_dist != b_dist || inc_prevs[id] != prevs[id] || !same_hops) {
+            std::cout << "SPF verify mismatch: " << ip_to_str(id) << " incremental " << a_dist << " full " << b_dist
+                      << std::endl;
+            mismatches++;
+        }
+    };
+    for (auto& pair : inc_nodes) {
+        check(pair.first);
+    }
+    for (auto& pair : nodes) {
+        if (inc_nodes.find(pair.first) == inc_nodes.end()) {
+            check(pair.first);
+        }
+    }
+    return mismatches == 0;
+}
+
+// 增量计算后更新直接后继：所有满足dist(u) + metric == dist(v)的入边起点u都是v的前驱，
+// v的直接后继集合为各前驱集合的并，最多保留max_paths个
+// seeds包含距离变化的结点、它们的后继以及入边变化的结点，即所有前驱集合可能变化的结点；
+// 按距离顺序处理，直接后继变化时再沿最短路径传播给后继，其余结点保持不变
+void Area::update_first_hops(const std::vector<uint32_t>& seeds) noexcept {
+    auto& dist = dense.dist;
+    auto root = nodes[root_id].index;
+    // (距离, 是否网络结点, 编号)：前驱的距离不大于后继，距离相等时（到网络结点的边度量为0）路由器在前
+    using Item = std::tuple<uint32_t, bool, uint32_t>;
+    auto heap = std::priority_queue<Item, std::vector<Item>, std::greater<Item>>();
+    for (auto v : seeds) {
+        if (dense.nodes[v] != nullptr) {
+            heap.emplace(dist[v], dense.masks[v] != 0, v);
+        }
+    }
+
+    dense.done.reset(dense.ids.size());
+    std::vector<Hop> hops;
+    while (!heap.empty()) {
+        auto v = std::get<2>(heap.top());
+        heap.pop();
+        if (!dense.done.insert(v)) {
+            continue;
+        }
+        auto& node = *dense.nodes[v];
+        hops.clear();
+        if (v != root && dist[v] != UINT32_MAX) {
+            for (auto& edge : dense.in[v]) {
+                auto u = edge.to;
+                if (dist[u] == UINT32_MAX || dist[u] + edge.metric != dist[v]) {
+                    continue;
+                }
+                if (u == root) {
+                    // 与根直连的网络不经过其它路由器
+                    if (dense.masks[v] == 0) {
+                        hops.push_back({node.id, edge.via});
+                    }
+                    continue;
+                }
+                auto& prev_hops = dense.nodes[u]->first_hops;
+                hops.insert(hops.end(), prev_hops.begin(), prev_hops.end());
+            }
+            std::sort(hops.begin(), hops.end());
+            hops.erase(std::unique(hops.begin(), hops.end()), hops.end());
+            if (hops.size() > max_paths) {
+                hops.resize(max_paths);
+            }
+        }
+        if (hops == node.first_hops) {
+            continue;
+        }
+        node.first_hops.swap(hops);
+        if (dist[v] == UINT32_MAX) {
+            // 不可达结点的后继的距离或前驱集合已经变化，都在seeds中
+            continue;
+        }
+        for (auto& edge : dense.out[v]) {
+            if (dist[v] + edge.metric == dist[edge.to]) {
+                heap.emplace(dist[edge.to], dense.masks[edge.to] != 0, edge.to);
+            }
+        }
+    }
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "lsdb.hpp"
+#include "pool.hpp"
+#include "timer.hpp"
+
+class Interface;
+
+/*
+ * OSPF区域：
+ * - 拥有自己的LSDB，LSA只在区域内的接口上洪泛；
+ * - 拥有自己的最短路径树，区域内计算只读取本区域的LSDB快照、只修改本区域的数据，
+ *   因此不同区域可以在不同线程中同时计算，之后再由路由表合并区域间路由。
+ */
+class Area {
+public:
+    uint32_t area_id;
+    LSDB lsdb;
+    /* 属于该区域的接口 */
+    std::vector<Interface *> interfaces;
+
+    explicit Area(uint32_t area_id);
+    Area(const Area&) = delete;
+    Area& operator=(const Area&) = delete;
+
+    /* 等待洪泛的LSA，已写为网络字节序；窗口内同一LSA的新实例覆盖旧实例 */
+    struct FloodQueue {
+        std::vector<PoolBytes> lsas;
+        using Key = std::tuple<LSA::Type, in_addr_t, in_addr_t>;
+        std::map<Key, size_t, std::less<Key>, PoolAllocator<std::pair<const Key, size_t>>> index;
+        size_t bytes = 0;
+        TimerWheel::TimerId timer = 0;
+    };
+    FloodQueue flood_queue;
+    std::mutex flood_mtx;
+
+public:
+    /* 最短路径树 */
+    // 根结点的一个直接后继：邻居路由器和本端接口地址（根的Router-LSA中该链路的link_data），
+    // 到同一邻居的平行链路是不同的下一跳（rfc2328 16.1.1）
+    struct Hop {
+        in_addr_t nbr_id;
+        in_addr_t intf_addr;
+        bool operator<(const Hop& rhs) const noexcept {
+            return nbr_id != rhs.nbr_id ? nbr_id < rhs.nbr_id : intf_addr < rhs.intf_addr;
+        }
+        bool operator==(const Hop& rhs) const noexcept {
+            return nbr_id == rhs.nbr_id && intf_addr == rhs.intf_addr;
+        }
+    };
+
+    struct Node {
+        in_addr_t id;
+        in_addr_t mask = 0;
+        uint32_t dist;
+        // 稠密编号，结点存在期间不变，结点回收后可分配给新结点
+        uint32_t index = 0;
+        // 经由的根结点直接后继（等价多路径），有序，最多max_paths个；与根直连的网络为空
+        std::vector<Hop> first_hops;
+        Node() = default;
+        Node(in_addr_t id, uint32_t dist) : id(id), dist(dist) {
+        }
+        Node(in_addr_t id, in_addr_t mask, uint32_t dist) : id(id), mask(mask), dist(dist) {
+        }
+    };
+
+    struct Edge {
+        in_addr_t dst;
+        uint32_t metric;
+        // 起点一侧的接口地址（链路的link_data），只有根的出边用于求直接后继
+        in_addr_t via = 0;
+        Edge() = default;
+        Edge(in_addr_t dst, uint32_t metric, in_addr_t via = 0) : dst(dst), metric(metric), via(via) {
+        }
+        bool operator==(const Edge& rhs) const noexcept {
+            return dst == rhs.dst && metric == rhs.metric && via == rhs.via;
+        }
+    };
+
+    uint32_t root_id;
+
+    // 路由器结点和网络结点
+    std::unordered_map<in_addr_t, Node> nodes;
+    // 每个结点的前驱结点，等价路径中取id最小者，构成最短路径树
+    std::unordered_map<in_addr_t, in_addr_t> prevs;
+
+    /* 最近一次计算取得的变化记录和LSDB快照，快照在路由表合并完成后放开 */
+    std::vector<LSDB::Change> changes;
+    std::shared_ptr<const LSDB::Snapshot> snapshot;
+    // 最近一次计算中第一类或第二类LSA是否变化，即最短路径树是否重新计算
+    bool intra_changed = false;
+
+    /* 区域内计算：取快照，全量或增量计算最短路径树，并求出直接后继 */
+    void run_spf(bool full_spf, bool verify_spf, uint32_t max_paths) noexcept;
+    void release_snapshot() noexcept {
+        snapshot.reset();
+    }
+
+    /* 结点的出边，用于展示拓扑；网络结点没有出边 */
+    std::vector<Edge> out_edges(in_addr_t id) const noexcept;
+
+    /* SPF统计 */
+    uint64_t spf_full_runs = 0;
+    uint64_t spf_incremental_runs = 0;
+    uint64_t spf_verify_failures = 0;
+
+private:
+    // Network-LSA在图中的贡献：网络结点id和连接的路由器
+    struct NetInfo {
+        in_addr_t node_id;
+        std::vector<in_addr_t> attached;
+    };
+    // 以Network-LSA的ls_id为键
+    std::unordered_map<in_addr_t, NetInfo> net_infos;
+    // 路由器所连接的网络（Network-LSA的ls_id）
+    std::unordered_map<in_addr_t, std::vector<in_addr_t>> attached_nets;
+    // 路由器通过TRANSIT链路引用的网络，以及反向的引用者集合
+    std::unordered_map<in_addr_t, std::vector<in_addr_t>> transit_links;
+    std::unordered_map<in_addr_t, std::vector<in_addr_t>> transit_refs;
+
+    // 最短路径树是否已经建立，未建立时只能全量计算
+    bool spt_built = false;
+    // 每个结点最多保留的直接后继数
+    uint32_t max_paths = 4;
+
+    // 按编号的边：to为终点（入边中为起点）的编号
+    struct DenseEdge {
+        uint32_t to;
+        uint32_t metric;
+        in_addr_t via;
+        bool operator==(const DenseEdge& rhs) const noexcept {
+            return to == rhs.to && metric == rhs.metric && via == rhs.via;
+        }
+        bool operator!=(const DenseEdge& rhs) const noexcept {
+            return !(*this == rhs);
+        }
+    };
+    // 按编号的访问标记，每次使用前调用reset，递增stamp即清除全部标记
+    struct Marks {
+        std::vector<uint32_t> stamps;
+        uint32_t stamp = 0;
+        void reset(size_t n) {
+            stamps.resize(n, 0);
+            if (++stamp == 0) {
+                std::fill(stamps.begin(), stamps.end(), 0);
+                stamp = 1;
+            }
+        }
+        bool insert(uint32_t i) {
+            if (stamps[i] == stamp) {
+                return false;
+            }
+            stamps[i] = stamp;
+            return true;
+        }
+        bool count(uint32_t i) const {
+            return stamps[i] == stamp;
+        }
+    };
+    // 图的稠密表示，全量和增量计算只访问这些数组，结果再写回nodes和prevs：
+    // - 结点加入图时分配编号，回收后编号进入free等待复用；
+    // - rebuild_edges在重建出边时直接维护按编号的出边和入边（入边的to为起点），计算前不再需要重新构建；
+    // - 网络结点没有出边。
+    struct DenseGraph {
+        std::vector<in_addr_t> ids; // 编号 -> 结点id
+        std::vector<Node *> nodes;  // 编号 -> nodes中的结点，空闲的编号为nullptr
+        std::vector<in_addr_t> masks;
+        std::vector<uint32_t> dist;
+        std::vector<uint32_t> prev; // 前驱的编号
+        std::vector<std::vector<DenseEdge>> out;
+        std::vector<std::vector<DenseEdge>> in;
+        std::vector<uint32_t> free;
+        // 全量计算中结点i的直接后继为hops[i * max_paths, i * max_paths + hop_counts[i])
+        std::vector<Hop> hops;
+        std::vector<uint32_t> hop_counts;
+        // 增量计算中失效、距离变化、需要重新选择前驱以及已求出直接后继的结点
+        Marks affected, changed, touched, done;
+    };
+    DenseGraph dense;
+
+    uint32_t add_node(in_addr_t id, in_addr_t mask) noexcept;
+    void remove_node(uint32_t index) noexcept;
+    std::vector<in_addr_t> set_net_info(in_addr_t ls_id) noexcept;
+    void rebuild_edges(in_addr_t rid, std::vector<uint32_t> *invalid,
+                       std::vector<std::pair<uint32_t, DenseEdge>> *relax, std::vector<uint32_t> *hop_seeds) noexcept;
+    void build_graph() noexcept;
+    bool apply_changes(const std::vector<LSDB::Change>& changes, std::vector<uint32_t>& invalid,
+                       std::vector<std::pair<uint32_t, DenseEdge>>& relax, std::vector<uint32_t>& hop_seeds) noexcept;
+    void dijkstra() noexcept;
+    void incremental_dijkstra(const std::vector<uint32_t>& invalid,
+                              const std::vector<std::pair<uint32_t, DenseEdge>>& relax,
+                              const std::vector<uint32_t>& hop_seeds) noexcept;
+    uint32_t canonical_prev(uint32_t v) noexcept;
+    bool verify_spt() noexcept;
+    void update_first_hops(const std::vector<uint32_t>& seeds) noexcept;
+};
+
+/* 本路由器连接的所有区域，按首次出现的顺序 */
+extern std::vector<Area *> this_areas;
+
+/* 查找区域，不存在时创建 */
+Area *get_area(uint32_t area_id);
+/* 连接多个区域的是区域边界路由器 */
+bool is_abr();
+/* 计算区域间路由时考察其Summary-LSA的区域：ABR只考察骨干区域（rfc2328 16.2） */
+std::vector<Area *> summary_areas();
+
+static inline void MAKE_ROUTER_LSA(Area *area) {
+    area->lsdb.lock();
+    area->lsdb.make_lsa(LSA::Type::ROUTER);
+    area->lsdb.unlock();
+}
+
+static inline void MAKE_NETWORK_LSA(Area *area, Interface *interface) {
+    area->lsdb.lock();
+    area->lsdb.make_lsa(LSA::Type::NETWORK, interface);
+    area->lsdb.unlock();
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+
+#include "fib.hpp"
+
+static inline in_addr_t len_to_mask(uint8_t len) noexcept {
+    return len == 0 ? 0 : ~0u << (32 - len);
+}
+
+// addr从高位数第pos位
+static inline int bit_at(in_addr_t addr, uint8_t pos) noexcept {
+    return (addr >> (31 - pos)) & 1;
+}
+
+PrefixTrie::PrefixTrie() {
+    // 根结点为0.0.0.0/0
+    nodes.emplace_back(0, 0);
+}
+
+int32_t PrefixTrie::new_node(in_addr_t prefix, uint8_t len) {
+    nodes.emplace_back(prefix & len_to_mask(len), len);
+    return nodes.size() - 1;
+}
+
+void PrefixTrie::insert(in_addr_t prefix, in_addr_t mask, const Value& value) {
+    uint8_t len = __builtin_popcount(mask);
+    prefix &= len_to_mask(len);
+
+    // 不变式：cur结点的前缀是待插入前缀的前缀
+    int32_t cur = 0;
+    while (true) {
+        if (nodes[cur].len == len) {
+            if (!nodes[cur].has_value) {
+                nodes[cur].has_value = true;
+                nodes[cur].value = value;
+                count++;
+            }
+            return;
+        }
+        auto bit = bit_at(prefix, nodes[cur].len);
+        auto next = nodes[cur].child[bit];
+        if (next < 0) {
+            auto leaf = new_node(prefix, len);
+            nodes[leaf].has_value = true;
+            nodes[leaf].value = value;
+            nodes[cur].child[bit] = leaf;
+            count++;
+            return;
+        }
+
+        // 待插入前缀与子结点前缀的公共长度
+        auto diff = prefix ^ nodes[next].prefix;
+        uint8_t common = diff == 0 ? 32 : __builtin_clz(diff);
+        common = std::min(common, std::min(len, nodes[next].len));
+        if (common == nodes[next].len) {
+            cur = next;
+            continue;
+        }
+
+        // 需要在cur与next之间插入结点
+        // 注意new_node可能使nodes重新分配，不能持有结点的引用
+        auto next_bit = bit_at(nodes[next].prefix, common);
+        if (common == len) {
+            auto mid = new_node(prefix, len);
+            nodes[mid].has_value = true;
+            nodes[mid].value = value;
+            nodes[mid].child[next_bit] = next;
+            nodes[cur].child[bit] = mid;
+        } else {
+            auto split = new_node(prefix, common);
+            auto leaf = new_node(prefix, len);
+            nodes[leaf].has_value = true;
+            nodes[leaf].value = value;
+            nodes[split].child[next_bit] = next;
+            nodes[split].child[next_bit ^ 1] = leaf;
+            nodes[cur].child[bit] = split;
+        }
+        count++;
+        return;
+    }
+}
+
+PrefixTrie::Value PrefixTrie::lookup(in_addr_t addr) const noexcept {
+    const Node *best = nullptr;
+    int32_t cur = 0;
+    while (cur >= 0) {
+        auto& node = nodes[cur];
+        if (((addr ^ node.prefix) & len_to_mask(node.len)) != 0) {
+            break;
+        }
+        if (node.has_value) {
+            best = &node;
+        }
+        if (node.len == 32) {
+            break;
+        }
+        cur = node.child[bit_at(addr, node.len)];
+    }
+    return best == nullptr ? Value(0, nullptr) : best->value;
+}
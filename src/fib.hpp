@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+
+class Interface;
+
+// 最长前缀匹配表，路径压缩的二叉字典树
+// 由路由表整体构建，构建完成后只读，可被多个线程同时查找
+class PrefixTrie {
+public:
+    using Value = std::pair<in_addr_t, Interface *>; // 下一跳和接口
+
+    PrefixTrie();
+    ~PrefixTrie() = default;
+
+    /* 插入前缀，同一前缀已存在时保留先插入的 */
+    void insert(in_addr_t prefix, in_addr_t mask, const Value& value);
+    /* 查找最长匹配，没有匹配时返回{0, nullptr} */
+    Value lookup(in_addr_t addr) const noexcept;
+    size_t size() const noexcept {
+        return count;
+    }
+
+private:
+    struct Node {
+        in_addr_t prefix;
+        uint8_t len;
+        bool has_value = false;
+        int32_t child[2] = {-1, -1};
+        Value value;
+        Node(in_addr_t prefix, uint8_t len) : prefix(prefix), len(len), value(0, nullptr) {
+        }
+    };
+    // 以下标代替指针，结点连续存放
+    std::vector<Node> nodes;
+    size_t count = 0;
+
+    int32_t new_node(in_addr_t prefix, uint8_t len);
+};
@@ -6,13 +6,17 @@
 #include <string>
 #include <vector>
 
+#include <linux/filter.h>
+#include <linux/if_packet.h>
 #include <net/if.h>
+#include <netinet/if_ether.h>
 #include <netinet/ip.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "area.hpp"
 #include "interface.hpp"
 #include "lsdb.hpp"
 #include "neighbor.hpp"
@@ -20,6 +24,7 @@
 #include "utils.hpp"
 
 std::vector<Interface *> this_interfaces;
+std::unordered_map<std::string, uint32_t> interface_areas;
 
 static const char *state_names[] = {"DOWN", "LOOPBACK", "WAITING", "POINT2POINT", "DROTHER", "BACKUP", "DR"};
 
@@ -105,7 +110,7 @@ void Interface::elect_designated_router() {
     }
 
     if (dr->ip_addr == ip_addr && designated_router != ip_addr) {
-        MAKE_NETWORK_LSA(this);
+        MAKE_NETWORK_LSA(area, this);
     }
 
     // printf("\n\tnew DR: %x\n", designated_router);
@@ -131,13 +136,32 @@ void Interface::event_interface_up() {
     case Type::BROADCAST:
     case Type::NBMA:
         state = State::WAITING;
+        // Wait计时器到期前未发现BDR，则自行选举（rfc2328 9.4）
+        wait_timer = this_timers.add(router_dead_interval * 1000, [this]() {
+            wait_timer = 0;
+            if (state == State::WAITING) {
+                event_wait_timer();
+            }
+        });
         break;
     default:
         break;
     }
+    start_hello_timer(0);
     std::cout << state_names[(int)state] << std::endl;
 }
 
+void Interface::start_hello_timer(uint32_t delay_ms) {
+    hello_timer = this_timers.add(delay_ms, [this]() {
+        hello_timer = 0;
+        if (state == State::DOWN) {
+            return;
+        }
+        OSPF::send_hello(this);
+        start_hello_timer(hello_interval * 1000);
+    });
+}
+
 // State::WAITING -> State::DR/BACKUP/DROTHER
 void Interface::event_wait_timer() {
     assert(state == State::WAITING);
@@ -151,12 +175,13 @@ void Interface::event_wait_timer() {
     } else {
         state = State::DROTHER;
     }
-    MAKE_ROUTER_LSA(this);
+    MAKE_ROUTER_LSA(area);
     std::cout << state_names[(int)state] << std::endl;
 }
 
 void Interface::event_backup_seen() {
     assert(state == State::WAITING);
+    this_timers.cancel_and_reset(wait_timer);
     elect_designated_router();
     std::cout << "Interface " << ip_to_str(ip_addr) << " received backup_seen:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
@@ -167,7 +192,7 @@ void Interface::event_backup_seen() {
     } else {
         state = State::DROTHER;
     }
-    MAKE_ROUTER_LSA(this);
+    MAKE_ROUTER_LSA(area);
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -183,7 +208,7 @@ void Interface::event_neighbor_change() {
     } else {
         state = State::DROTHER;
     }
-    MAKE_ROUTER_LSA(this);
+    MAKE_ROUTER_LSA(area);
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -205,7 +230,14 @@ void Interface::event_interface_down() {
     std::cout << "Interface " << ip_to_str(ip_addr) << " received interface_down:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
     state = State::DOWN;
-    MAKE_ROUTER_LSA(this);
+    this_timers.cancel_and_reset(hello_timer);
+    this_timers.cancel_and_reset(wait_timer);
+    {
+        std::lock_guard<std::mutex> lock(ack_mtx);
+        this_timers.cancel_and_reset(ack_timer);
+        pending_acks.clear();
+    }
+    MAKE_ROUTER_LSA(area);
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -227,7 +259,125 @@ Neighbor *Interface::get_neighbor_by_ip(in_addr_t ip) {
     return nullptr;
 }
 
-void init_interfaces() {
+// 挂载经典BPF过滤器，只让IPv4 OSPF报文进入用户态
+// 偏移均相对于以太网帧头：IP协议字段位于14+9，目的地址位于14+16
+static int attach_ospf_filter(int fd, Interface *intf) {
+    const uint32_t all_spf = ntohl(inet_addr(OSPF::ALL_SPF_ROUTERS));
+    const uint32_t all_dr = ntohl(inet_addr(OSPF::ALL_DR_ROUTERS));
+    const uint32_t accept = 0x40000;
+
+    std::vector<sock_filter> code;
+    code.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, sizeof(ethhdr) + offsetof(iphdr, protocol)));
+    if (intf->filter_dst) {
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_OSPF, 0, 5));
+        code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, sizeof(ethhdr) + offsetof(iphdr, daddr)));
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, intf->ip_addr, 2, 0));
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, all_spf, 1, 0));
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, all_dr, 0, 1));
+    } else {
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_OSPF, 0, 1));
+    }
+    code.push_back(BPF_STMT(BPF_RET | BPF_K, accept));
+    code.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+
+    sock_fprog prog;
+    prog.len = code.size();
+    prog.filter = code.data();
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        return -1;
+    }
+
+    // 丢弃过滤器挂载前已经进入队列的帧
+    char drain[ETH_FRAME_LEN];
+    while (recv(fd, drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+    }
+    return 0;
+}
+
+// 不开混杂模式时，需要让网卡接收AllSPFRouters/AllDRouters对应的组播MAC
+static int join_ospf_multicast(int fd, Interface *intf) {
+    const uint8_t macs[][ETH_ALEN] = {{0x01, 0x00, 0x5e, 0x00, 0x00, 0x05}, {0x01, 0x00, 0x5e, 0x00, 0x00, 0x06}};
+    for (auto& mac : macs) {
+        packet_mreq mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.mr_ifindex = intf->if_index;
+        mreq.mr_type = PACKET_MR_MULTICAST;
+        mreq.mr_alen = ETH_ALEN;
+        memcpy(mreq.mr_address, mac, ETH_ALEN);
+        if (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void Interface::update_rx_stats() {
+    tpacket_stats stats;
+    socklen_t len = sizeof(stats);
+    if (getsockopt(recv_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0) {
+        perror("getsockopt PACKET_STATISTICS");
+        return;
+    }
+    rx_kernel_drops += stats.tp_drops;
+}
+
+void Interface::queue_ack(const LSA::Header& lsahdr) {
+    std::unique_lock<std::mutex> lock(ack_mtx);
+    pending_acks.push_back(lsahdr);
+    delayed_acks++;
+    if ((pending_acks.size() + 1) * sizeof(LSA::Header) > mtu - sizeof(iphdr) - sizeof(OSPF::Header)) {
+        // 已装满一个报文
+        lock.unlock();
+        flush_acks();
+        return;
+    }
+    if (ack_timer == 0) {
+        ack_timer = this_timers.add(ack_delay_ms, [this]() { flush_acks(); });
+    }
+}
+
+// RFC 2328 13.5：DR和BDR发往AllSPFRouters，其它路由器发往AllDRouters
+void Interface::flush_acks() {
+    // 与pending_acks交换，两者的容量都在线程内复用
+    static thread_local std::vector<LSA::Header> acks;
+    acks.clear();
+    {
+        std::lock_guard<std::mutex> lock(ack_mtx);
+        this_timers.cancel_and_reset(ack_timer);
+        acks.swap(pending_acks);
+    }
+    if (acks.empty() || state == State::DOWN) {
+        return;
+    }
+    auto dst = OSPF::ALL_SPF_ROUTERS;
+    if (type == Type::BROADCAST && state != State::DR && state != State::BACKUP) {
+        dst = OSPF::ALL_DR_ROUTERS;
+    }
+    OSPF::send_lsack(this, acks, ntohl(inet_addr(dst)));
+}
+
+void print_interface_stats(std::ostream& os) {
+    os << "Interface Statistics:" << std::endl;
+    for (auto intf : this_interfaces) {
+        intf->update_rx_stats();
+        os << intf->name << ":" << std::endl
+           << "	promisc: " << (intf->promisc ? "on" : "off") << std::endl
+           << "	rx frames: " << intf->rx_frames << std::endl
+           << "	rx kernel drops: " << intf->rx_kernel_drops << std::endl
+           << "	rx bad packets/lsas: " << intf->rx_bad_packets << "/" << intf->rx_bad_lsas << std::endl
+           << "	mtu: " << intf->mtu << std::endl
+           << "	tx lsu packets/lsas: " << intf->tx_lsu_packets << "/" << intf->tx_lsu_lsas << std::endl
+           << "	tx lsack packets: " << intf->tx_lsack_packets << " (delayed acks " << intf->delayed_acks << ")"
+           << std::endl;
+        for (auto nbr : intf->neighbors) {
+            os << "	neighbor " << ip_to_str(nbr->ip_addr) << ": rxmt outstanding " << nbr->rxmt_outstanding()
+               << ", retransmitted " << nbr->lsa_retransmitted << ", acked " << nbr->lsa_acked
+               << ", requests " << nbr->request_outstanding() << ", lsr sent " << nbr->lsr_sent << std::endl;
+        }
+    }
+}
+
+void init_interfaces(bool promisc) {
     int fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (fd < 0) {
         exit(EXIT_FAILURE);
@@ -269,7 +419,8 @@ void init_interfaces() {
             continue;
         }
         intf->mask = ntohl(((sockaddr_in *)&ifr->ifr_addr)->sin_addr.s_addr);
-        intf->area_id = 0;
+        auto area_it = interface_areas.find(intf->name);
+        intf->area_id = area_it != interface_areas.end() ? area_it->second : 0;
 
         // fetch interface index
         if (ioctl(fd, SIOCGIFINDEX, ifr) < 0) {
@@ -279,17 +430,27 @@ void init_interfaces() {
         }
         intf->if_index = ifr->ifr_ifindex;
 
-        // turn on promisc mode
-        if (ioctl(fd, SIOCGIFFLAGS, ifr) < 0) {
-            perror("ioctl SIOCGIFFLAGS");
-            delete intf;
-            continue;
+        // fetch interface mtu
+        if (ioctl(fd, SIOCGIFMTU, ifr) < 0) {
+            perror("ioctl SIOCGIFMTU");
+        } else {
+            intf->mtu = ifr->ifr_mtu;
         }
-        ifr->ifr_flags |= IFF_PROMISC;
-        if (ioctl(fd, SIOCSIFFLAGS, ifr) < 0) {
-            perror("ioctl SIOCSIFFLAGS");
-            delete intf;
-            continue;
+
+        // turn on promisc mode (optional)
+        intf->promisc = promisc;
+        if (intf->promisc) {
+            if (ioctl(fd, SIOCGIFFLAGS, ifr) < 0) {
+                perror("ioctl SIOCGIFFLAGS");
+                delete intf;
+                continue;
+            }
+            ifr->ifr_flags |= IFF_PROMISC;
+            if (ioctl(fd, SIOCSIFFLAGS, ifr) < 0) {
+                perror("ioctl SIOCSIFFLAGS");
+                delete intf;
+                continue;
+            }
         }
 
         // alloc send fd
@@ -304,6 +465,7 @@ void init_interfaces() {
         strcpy(socket_ifr.ifr_name, intf->name);
         if (setsockopt(socket_fd, SOL_SOCKET, SO_BINDTODEVICE, &socket_ifr, sizeof(ifreq)) < 0) {
             perror("send_loop: setsockopt");
+            close(socket_fd);
             delete intf;
             continue;
         }
@@ -319,6 +481,19 @@ void init_interfaces() {
         strcpy(socket_ifr.ifr_name, intf->name);
         if (setsockopt(socket_fd, SOL_SOCKET, SO_BINDTODEVICE, &socket_ifr, sizeof(ifreq)) < 0) {
             perror("recv_loop: setsockopt");
+            close(socket_fd);
+            delete intf;
+            continue;
+        }
+        if (attach_ospf_filter(socket_fd, intf) < 0) {
+            perror("recv_loop: SO_ATTACH_FILTER");
+            close(socket_fd);
+            delete intf;
+            continue;
+        }
+        if (!intf->promisc && join_ospf_multicast(socket_fd, intf) < 0) {
+            perror("recv_loop: PACKET_ADD_MEMBERSHIP");
+            close(socket_fd);
             delete intf;
             continue;
         }
@@ -326,6 +501,8 @@ void init_interfaces() {
 
         // add to interfaces
         this_interfaces.push_back(intf);
+        intf->area = get_area(intf->area_id);
+        intf->area->interfaces.push_back(intf);
     }
 
     close(fd);
@@ -334,19 +511,27 @@ void init_interfaces() {
     for (auto intf : this_interfaces) {
         std::cout << "Interface " << intf->name << ":" << std::endl
                   << "\tip addr:" << ip_to_str(intf->ip_addr) << std::endl
-                  << "\tmask:" << ip_to_str(intf->mask) << std::endl;
-        intf->hello_timer = 0;
-        intf->wait_timer = 0;
+                  << "\tmask:" << ip_to_str(intf->mask) << std::endl
+                  << "\tarea:" << ip_to_str(intf->area_id) << std::endl
+                  << "\tmtu:" << intf->mtu << std::endl;
         intf->event_interface_up();
     }
 }
 
 Interface::~Interface() {
+    this_timers.cancel_and_reset(hello_timer);
+    this_timers.cancel_and_reset(wait_timer);
+    this_timers.cancel_and_reset(ack_timer);
     // clear_neighbors();
     for (auto& neighbor : neighbors) {
         delete neighbor;
     }
 
     // close send fd
-    close(send_fd);
+    if (send_fd >= 0) {
+        close(send_fd);
+    }
+    if (recv_fd >= 0) {
+        close(recv_fd);
+    }
 }
\ No newline at end of file
@@ -1,11 +1,21 @@
 #pragma once
 
+#include <cstdint>
 #include <list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <net/if.h>
+#include <netinet/if_ether.h>
 #include <netinet/in.h>
 
+#include "packet.hpp"
+#include "timer.hpp"
+
+class Area;
 class Neighbor;
 
 /*
@@ -42,6 +52,8 @@ public:
     in_addr_t mask;
     /* 区域标识 */
     uint32_t area_id;
+    /* 所属的区域，由init_interfaces按area_id设置 */
+    Area *area = nullptr;
 
     /* 从该接口发送Hello报文的时间间隔 */
     uint32_t hello_interval = 10;
@@ -56,9 +68,9 @@ public:
     uint8_t router_priority = 1;
 
     /* Hello计时器 */
-    uint32_t hello_timer = 0;
+    TimerWheel::TimerId hello_timer = 0;
     /* Wait计时器 */
-    uint32_t wait_timer = 0;
+    TimerWheel::TimerId wait_timer = 0;
 
     /* 该接口的邻接路由器 */
     std::list<Neighbor *> neighbors;
@@ -82,6 +94,34 @@ public:
     /* 接口index */
     int if_index;
 
+    /* 接口MTU（IP层），决定一个OSPF报文最多能装多少LSA */
+    uint32_t mtu = ETH_DATA_LEN;
+
+    /* 是否开启混杂模式，默认关闭，由组播成员关系接收OSPF报文 */
+    bool promisc = false;
+    /* 内核过滤器是否同时检查目的地址（本接口地址或AllSPFRouters/AllDRouters） */
+    bool filter_dst = true;
+
+    /* 接收统计 */
+    uint64_t rx_frames = 0;       // 通过内核过滤器、交付到用户态的帧数
+    uint64_t rx_kernel_drops = 0; // 内核因接收队列满而丢弃的帧数
+    uint64_t rx_bad_packets = 0;  // 长度、校验和或区域错误而丢弃的OSPF报文数
+    uint64_t rx_bad_lsas = 0;     // LSU中长度或校验和错误而丢弃的LSA数
+
+    /* 发送统计 */
+    uint64_t tx_lsu_packets = 0;   // 发出的LSU报文数
+    uint64_t tx_lsu_lsas = 0;      // LSU中携带的LSA数
+    uint64_t tx_lsack_packets = 0; // 发出的LSAck报文数（含直接确认）
+    uint64_t delayed_acks = 0;     // 延迟确认的LSA数
+
+    /* 延迟确认：收到的LSA在ack_delay_ms内合并到同一个LSAck中，装满一个报文时立即发送 */
+    uint32_t ack_delay_ms = 1000;
+    void queue_ack(const LSA::Header& lsahdr);
+    void flush_acks();
+
+    /* 从内核读取并累加PACKET_STATISTICS（读取后内核计数清零） */
+    void update_rx_stats();
+
 public:
     /* 改变接口状态的事件 */
     void event_interface_up();
@@ -97,8 +137,8 @@ public:
 
 public:
     /* loop fd，不在构造函数中初始化，避免抛出异常 */
-    int send_fd;
-    int recv_fd;
+    int send_fd = -1;
+    int recv_fd = -1;
 
 public:
     Interface() = default;
@@ -109,9 +149,20 @@ public:
 private:
     /* 选举DR和BDR */
     void elect_designated_router();
+    /* delay_ms后发送Hello，之后每hello_interval秒发送一次 */
+    void start_hello_timer(uint32_t delay_ms);
+
+    /* 等待发送的延迟确认，主机字节序 */
+    std::vector<LSA::Header> pending_acks;
+    std::mutex ack_mtx;
+    TimerWheel::TimerId ack_timer = 0;
 };
 
 extern std::vector<Interface *> this_interfaces;
 constexpr const int MAX_INTERFACE_NUM = 16;
 
-void init_interfaces();
\ No newline at end of file
+/* 接口名到区域标识的配置，未配置的接口属于骨干区域 */
+extern std::unordered_map<std::string, uint32_t> interface_areas;
+
+void init_interfaces(bool promisc = false);
+void print_interface_stats(std::ostream& os);
\ No newline at end of file
@@ -1,37 +1,57 @@
 #include <algorithm>
 #include <iostream>
 
+#include "area.hpp"
 #include "interface.hpp"
 #include "lsdb.hpp"
 #include "neighbor.hpp"
 #include "packet.hpp"
 #include "route.hpp"
 #include "transit.hpp"
+#include "utils.hpp"
 
-LSDB this_lsdb;
+void LSDB::mark_changed(LSA::Type type, uint32_t ls_id, uint32_t adv_rtr) noexcept {
+    changes.push_back({type, ls_id, adv_rtr});
+    version++;
+    this_routing_table.schedule_spf();
+}
 
-void LSDB::add(LSA::Base *lsa) noexcept {
-    LSA::Base *old_lsa = get(lsa->header.type, lsa->header.link_state_id, lsa->header.advertising_router);
-    if (old_lsa != nullptr) {
-        if (*lsa > *old_lsa) {
-            del(lsa->header.type, lsa->header.link_state_id, lsa->header.advertising_router);
-        }
-    }
+LSA::Base *LSDB::add(LSA::Base *lsa, bool *installed) noexcept {
     switch (lsa->header.type) {
     case LSA::Type::ROUTER:
-        router_lsas.emplace_back(static_cast<RouterLSA *>(lsa));
+        return install(router_lsas, static_cast<RouterLSA *>(lsa), installed);
+    case LSA::Type::NETWORK:
+        return install(network_lsas, static_cast<NetworkLSA *>(lsa), installed);
+    case LSA::Type::SUMMARY:
+        return install(summary_lsas, static_cast<SummaryLSA *>(lsa), installed);
+    case LSA::Type::ASBR_SUMMARY:
+        return install(asbr_summary_lsas, static_cast<ASBRSummaryLSA *>(lsa), installed);
+    case LSA::Type::AS_EXTERNAL:
+        return install(as_external_lsas, static_cast<ASExternalLSA *>(lsa), installed);
+    default:
+        assert(false && "Not implemented yet");
+        break;
+    }
+    return nullptr;
+}
+
+void LSDB::del(LSA::Type type, uint32_t ls_id, uint32_t adv_rtr) noexcept {
+    mark_changed(type, ls_id, adv_rtr);
+    switch (type) {
+    case LSA::Type::ROUTER:
+        writable(router_lsas).erase(ls_id, adv_rtr);
         break;
     case LSA::Type::NETWORK:
-        network_lsas.emplace_back(static_cast<NetworkLSA *>(lsa));
+        writable(network_lsas).erase(ls_id, adv_rtr);
         break;
     case LSA::Type::SUMMARY:
-        summary_lsas.emplace_back(static_cast<SummaryLSA *>(lsa));
+        writable(summary_lsas).erase(ls_id, adv_rtr);
         break;
     case LSA::Type::ASBR_SUMMARY:
-        asbr_summary_lsas.emplace_back(static_cast<ASBRSummaryLSA *>(lsa));
+        writable(asbr_summary_lsas).erase(ls_id, adv_rtr);
         break;
     case LSA::Type::AS_EXTERNAL:
-        as_external_lsas.emplace_back(static_cast<ASExternalLSA *>(lsa));
+        writable(as_external_lsas).erase(ls_id, adv_rtr);
         break;
     default:
         assert(false && "Not implemented yet");
@@ -39,97 +59,85 @@ void LSDB::add(LSA::Base *lsa) noexcept {
     }
 }
 
-void LSDB::del(LSA::Type type, uint32_t ls_id, uint32_t adv_rtr) noexcept {
-    if (type == LSA::Type::ROUTER) {
-        auto it = std::find_if(router_lsas.begin(), router_lsas.end(), [ls_id, adv_rtr](RouterLSA *rlsa) {
-            return rlsa->header.link_state_id == ls_id && rlsa->header.advertising_router == adv_rtr;
-        });
-        if (it != router_lsas.end()) {
-            delete *it;
-            router_lsas.erase(it);
-        }
-    } else if (type == LSA::Type::NETWORK) {
-        auto it = std::find_if(network_lsas.begin(), network_lsas.end(), [ls_id, adv_rtr](NetworkLSA *nlsa) {
-            return nlsa->header.link_state_id == ls_id && nlsa->header.advertising_router == adv_rtr;
-        });
-        if (it != network_lsas.end()) {
-            delete *it;
-            network_lsas.erase(it);
-        }
-    } else if (type == LSA::Type::SUMMARY) {
-        auto it = std::find_if(summary_lsas.begin(), summary_lsas.end(), [ls_id, adv_rtr](SummaryLSA *slsa) {
-            return slsa->header.link_state_id == ls_id && slsa->header.advertising_router == adv_rtr;
-        });
-        if (it != summary_lsas.end()) {
-            delete *it;
-            summary_lsas.erase(it);
-        }
-    } else {
+void LSDB::replace(LSA::Base *lsa) noexcept {
+    switch (lsa->header.type) {
+    case LSA::Type::ROUTER:
+        writable(router_lsas).put(static_cast<RouterLSA *>(lsa));
+        break;
+    case LSA::Type::NETWORK:
+        writable(network_lsas).put(static_cast<NetworkLSA *>(lsa));
+        break;
+    case LSA::Type::SUMMARY:
+        writable(summary_lsas).put(static_cast<SummaryLSA *>(lsa));
+        break;
+    case LSA::Type::ASBR_SUMMARY:
+        writable(asbr_summary_lsas).put(static_cast<ASBRSummaryLSA *>(lsa));
+        break;
+    case LSA::Type::AS_EXTERNAL:
+        writable(as_external_lsas).put(static_cast<ASExternalLSA *>(lsa));
+        break;
+    default:
         assert(false && "Not implemented yet");
+        break;
     }
 }
 
 LSA::Base *LSDB::get(LSA::Type type, uint32_t ls_id, uint32_t adv_rtr) noexcept {
-    if (type == LSA::Type::ROUTER) {
-        auto it = std::find_if(router_lsas.begin(), router_lsas.end(), [ls_id, adv_rtr](RouterLSA *rlsa) {
-            return rlsa->header.link_state_id == ls_id && rlsa->header.advertising_router == adv_rtr;
-        });
-        return it != router_lsas.end() ? *it : nullptr;
-    } else if (type == LSA::Type::NETWORK) {
-        auto it = std::find_if(network_lsas.begin(), network_lsas.end(), [ls_id, adv_rtr](NetworkLSA *nlsa) {
-            return nlsa->header.link_state_id == ls_id && nlsa->header.advertising_router == adv_rtr;
-        });
-        return it != network_lsas.end() ? *it : nullptr;
-    } else if (type == LSA::Type::SUMMARY) {
-        auto it = std::find_if(summary_lsas.begin(), summary_lsas.end(), [ls_id, adv_rtr](SummaryLSA *slsa) {
-            return slsa->header.link_state_id == ls_id && slsa->header.advertising_router == adv_rtr;
-        });
-        return it != summary_lsas.end() ? *it : nullptr;
-    } else if (type == LSA::Type::ASBR_SUMMARY) {
-        auto it = std::find_if(
-            asbr_summary_lsas.begin(), asbr_summary_lsas.end(), [ls_id, adv_rtr](ASBRSummaryLSA *asbrslsa) {
-                return asbrslsa->header.link_state_id == ls_id && asbrslsa->header.advertising_router == adv_rtr;
-            });
-        return it != asbr_summary_lsas.end() ? *it : nullptr;
-    } else if (type == LSA::Type::AS_EXTERNAL) {
-        auto it =
-            std::find_if(as_external_lsas.begin(), as_external_lsas.end(), [ls_id, adv_rtr](ASExternalLSA *aselsa) {
-                return aselsa->header.link_state_id == ls_id && aselsa->header.advertising_router == adv_rtr;
-            });
-        return it != as_external_lsas.end() ? *it : nullptr;
+    switch (type) {
+    case LSA::Type::ROUTER:
+        return router_lsas->get(ls_id, adv_rtr);
+    case LSA::Type::NETWORK:
+        return network_lsas->get(ls_id, adv_rtr);
+    case LSA::Type::SUMMARY:
+        return summary_lsas->get(ls_id, adv_rtr);
+    case LSA::Type::ASBR_SUMMARY:
+        return asbr_summary_lsas->get(ls_id, adv_rtr);
+    case LSA::Type::AS_EXTERNAL:
+        return as_external_lsas->get(ls_id, adv_rtr);
+    default:
+        break;
     }
     return nullptr;
 }
 
-RouterLSA *LSDB::get_router_lsa(uint32_t ls_id, uint32_t adv_rtr) {
-    auto it = std::find_if(router_lsas.begin(), router_lsas.end(), [ls_id, adv_rtr](RouterLSA *rlsa) {
-        return rlsa->header.link_state_id == ls_id && rlsa->header.advertising_router == adv_rtr;
-    });
-    return it != router_lsas.end() ? *it : nullptr;
+// 以下供路由计算使用，不返回已清除的LSA
+template <typename T>
+static T *unless_maxage(T *lsa) noexcept {
+    return lsa != nullptr && !lsa->is_maxage() ? lsa : nullptr;
 }
 
-RouterLSA *LSDB::get_router_lsa(uint32_t ls_id) {
-    auto it = std::find_if(router_lsas.begin(), router_lsas.end(),
-                           [ls_id](RouterLSA *rlsa) { return rlsa->header.link_state_id == ls_id; });
-    return it != router_lsas.end() ? *it : nullptr;
+RouterLSA *LSDB::Snapshot::get_router_lsa(uint32_t ls_id, uint32_t adv_rtr) const noexcept {
+    return unless_maxage(router_lsas->get(ls_id, adv_rtr));
 }
 
-NetworkLSA *LSDB::get_network_lsa(uint32_t ls_id, uint32_t adv_rtr) {
-    auto it = std::find_if(network_lsas.begin(), network_lsas.end(), [ls_id, adv_rtr](NetworkLSA *nlsa) {
-        return nlsa->header.link_state_id == ls_id && nlsa->header.advertising_router == adv_rtr;
-    });
-    return it != network_lsas.end() ? *it : nullptr;
+RouterLSA *LSDB::Snapshot::get_router_lsa(uint32_t ls_id) const noexcept {
+    return unless_maxage(router_lsas->get(ls_id));
 }
 
-NetworkLSA *LSDB::get_network_lsa(uint32_t ls_id) {
-    auto it = std::find_if(network_lsas.begin(), network_lsas.end(),
-                           [ls_id](NetworkLSA *nlsa) { return nlsa->header.link_state_id == ls_id; });
-    return it != network_lsas.end() ? *it : nullptr;
+NetworkLSA *LSDB::Snapshot::get_network_lsa(uint32_t ls_id, uint32_t adv_rtr) const noexcept {
+    return unless_maxage(network_lsas->get(ls_id, adv_rtr));
+}
+
+NetworkLSA *LSDB::Snapshot::get_network_lsa(uint32_t ls_id) const noexcept {
+    return unless_maxage(network_lsas->get(ls_id));
+}
+
+std::shared_ptr<const LSDB::Snapshot> LSDB::snapshot() {
+    auto snap = published.lock();
+    if (snap != nullptr && snap->version == version) {
+        return snap;
+    }
+    snap = std::make_shared<const Snapshot>(
+        Snapshot{version, router_lsas, network_lsas, summary_lsas, asbr_summary_lsas, as_external_lsas});
+    published = snap;
+    snapshots++;
+    return snap;
 }
 
 std::atomic<size_t> lsa_seq_num(0x80000001); // 本地LSA序列号
 
-static RouterLSA *make_router_lsa() noexcept {
+// 只描述本区域的接口
+static RouterLSA *make_router_lsa(Area *area) noexcept {
     auto rlsa = new RouterLSA();
 
     // 构造header
@@ -143,13 +151,12 @@ static RouterLSA *make_router_lsa() noexcept {
     rlsa->header.checksum = 0; //
 
     // 构造第1类LSA
-    for (auto& interface : this_interfaces) {
+    for (auto& interface : area->interfaces) {
         if (interface->state == Interface::State::DOWN) {
             continue;
         }
         auto link = RouterLSA::Link();
         link.metric = interface->cost;
-        link.tos = 0;
         if ((interface->state != Interface::State::WAITING) &&
             (interface->designated_router == interface->ip_addr ||
              interface->get_neighbor_by_ip(interface->designated_router)->state == Neighbor::State::FULL)) {
@@ -163,18 +170,16 @@ static RouterLSA *make_router_lsa() noexcept {
             link.link_id = interface->ip_addr & interface->mask;
             link.link_data = interface->mask;
         }
-        rlsa->links.emplace_back(link);
+        rlsa->add_link(link);
     }
 
-    rlsa->num_links = rlsa->links.size();
-    rlsa->header.length = rlsa->size();
     rlsa->make_checksum();
 
     return rlsa;
 }
 
 static NetworkLSA *make_network_lsa(Interface *interface) noexcept {
-    NetworkLSA *nlsa = new NetworkLSA();
+    NetworkLSA *nlsa = new NetworkLSA(interface->mask);
 
     // 构造header
     nlsa->header.age = 0;
@@ -187,19 +192,31 @@ static NetworkLSA *make_network_lsa(Interface *interface) noexcept {
     nlsa->header.checksum = 0; //
 
     // 构造第2类LSA
-    nlsa->network_mask = interface->mask;
     for (auto& neighbor : interface->neighbors) {
         if (neighbor->state == Neighbor::State::FULL) {
-            nlsa->attached_routers.emplace_back(neighbor->ip_addr);
+            nlsa->add_attached_router(neighbor->ip_addr);
         }
     }
 
-    nlsa->header.length = nlsa->size();
     nlsa->make_checksum();
 
     return nlsa;
 }
 
+// 新实例的序列号必须大于数据库中的实例（rfc2328 13.4），
+// 例如重启后邻居送回了上次运行时序列号更大的实例
+static void supersede(LSA::Base *lsa, const LSA::Base *old_lsa) noexcept {
+    if (lsa->header.sequence_number > old_lsa->header.sequence_number) {
+        return;
+    }
+    lsa->header.sequence_number = old_lsa->header.sequence_number + 1;
+    size_t next = (size_t)lsa->header.sequence_number + 1;
+    auto cur = lsa_seq_num.load();
+    while (cur < next && !lsa_seq_num.compare_exchange_weak(cur, next)) {
+    }
+    lsa->make_checksum();
+}
+
 // 由调用者保证已锁
 void LSDB::make_lsa(LSA::Type type, Interface *interface) noexcept {
     auto this_rid = ntohl(inet_addr(THIS_ROUTER_ID));
@@ -207,25 +224,213 @@ void LSDB::make_lsa(LSA::Type type, Interface *interface) noexcept {
     if (type == LSA::Type::ROUTER) {
         auto rlsa = static_cast<RouterLSA *>(get(LSA::Type::ROUTER, this_rid, this_rid));
         if (rlsa == nullptr) {
-            rlsa = make_router_lsa();
-            router_lsas.emplace_back(rlsa);
+            rlsa = make_router_lsa(area);
+            writable(router_lsas).put(rlsa);
+            mark_changed(LSA::Type::ROUTER, this_rid, this_rid);
+            schedule_aging(rlsa);
             // 此时不洪泛，只在本地更新
         } else {
-            auto new_rlsa = make_router_lsa();
-            add(new_rlsa); // add中会将（可能存在的）旧LSA删除
-            OSPF::flood_lsa(new_rlsa);
+            auto new_rlsa = make_router_lsa(area);
+            supersede(new_rlsa, rlsa);
+            // add中会将旧LSA删除；未安装时新实例已被释放，返回的是数据库中的实例
+            bool installed = false;
+            auto lsa = add(new_rlsa, &installed);
+            if (installed) {
+                OSPF::flood_lsa(area, lsa);
+            }
         }
     } else if (type == LSA::Type::NETWORK) {
         auto nlsa = static_cast<NetworkLSA *>(get(LSA::Type::NETWORK, interface->ip_addr, this_rid));
         if (nlsa == nullptr) {
             nlsa = make_network_lsa(interface);
-            network_lsas.emplace_back(nlsa);
+            writable(network_lsas).put(nlsa);
+            mark_changed(LSA::Type::NETWORK, interface->ip_addr, this_rid);
+            schedule_aging(nlsa);
         } else {
             auto new_nlsa = make_network_lsa(interface);
-            add(new_nlsa);
-            OSPF::flood_lsa(new_nlsa);
+            supersede(new_nlsa, nlsa);
+            bool installed = false;
+            auto lsa = add(new_nlsa, &installed);
+            if (installed) {
+                OSPF::flood_lsa(area, lsa);
+            }
         }
     } else {
         assert(false && "Not implemented yet");
     }
-}
\ No newline at end of file
+}
+
+// 到期时刻取决于header.age和收到的时刻，因此只需在安装时计算一次
+void LSDB::schedule_aging(LSA::Base *lsa) noexcept {
+    if (lsa->is_maxage()) {
+        // 收到的或自己清除的MaxAge实例，等待删除
+        maxage_lsas.push_back({lsa->header.type, lsa->header.link_state_id, lsa->header.advertising_router});
+        return;
+    }
+    auto self = lsa->header.advertising_router == ntohl(inet_addr(THIS_ROUTER_ID));
+    uint32_t lifetime = self ? LSA::LS_REFRESH_TIME : LSA::MAX_AGE;
+    uint32_t age = lsa->header.age;
+    auto deadline = lsa->arrival + (age < lifetime ? lifetime - age : 0);
+    // 不放入已经检查过的桶
+    deadline = std::max(deadline, aging_cursor + 1);
+    aging_buckets[deadline % LSA::MAX_AGE].push_back({deadline, lsa->header.sequence_number,
+                                                      lsa->header.link_state_id, lsa->header.advertising_router,
+                                                      lsa->header.type});
+}
+
+// 检查第now秒的桶：其中还有到期时刻在一圈之后的记录，保留
+void LSDB::age_bucket(uint32_t now) noexcept {
+    auto& bucket = aging_buckets[now % LSA::MAX_AGE];
+    std::vector<AgingEntry> due;
+    size_t kept = 0;
+    for (auto& entry : bucket) {
+        if (entry.deadline > now) {
+            bucket[kept++] = entry;
+        } else {
+            due.push_back(entry);
+        }
+    }
+    bucket.resize(kept);
+
+    auto this_rid = ntohl(inet_addr(THIS_ROUTER_ID));
+    for (auto& entry : due) {
+        auto lsa = get(entry.type, entry.ls_id, entry.adv_rtr);
+        // 已被替换、删除或清除
+        if (lsa == nullptr || lsa->header.sequence_number != entry.seq || lsa->is_maxage()) {
+            continue;
+        }
+        if (entry.adv_rtr == this_rid) {
+            refresh_lsa(lsa);
+        } else if (lsa->current_age() >= LSA::MAX_AGE) {
+            flush_lsa(lsa);
+        } else {
+            schedule_aging(lsa);
+        }
+    }
+}
+
+// 自己的LSA到达LSRefreshTime：重新生成一个序列号更大的实例，已不再需要的则清除
+void LSDB::refresh_lsa(LSA::Base *lsa) noexcept {
+    if (lsa->header.type == LSA::Type::ROUTER) {
+        make_lsa(LSA::Type::ROUTER);
+        lsa_refreshed++;
+        return;
+    }
+    if (lsa->header.type == LSA::Type::NETWORK) {
+        for (auto& intf : area->interfaces) {
+            if (intf->ip_addr == lsa->header.link_state_id && intf->state == Interface::State::DR) {
+                make_lsa(LSA::Type::NETWORK, intf);
+                lsa_refreshed++;
+                return;
+            }
+        }
+    }
+    flush_lsa(lsa);
+}
+
+// 快照中可能仍引用原实例，不能原地修改年龄，换上一个MaxAge的副本
+void LSDB::flush_lsa(LSA::Base *lsa) noexcept {
+    auto flushed = lsa->clone();
+    flushed->set_age(LSA::MAX_AGE);
+    replace(flushed);
+    mark_changed(flushed->header.type, flushed->header.link_state_id, flushed->header.advertising_router);
+    schedule_aging(flushed);
+    // 原实例可能随即被释放，重传列表改为等待副本的确认
+    discard_rxmt(flushed->header.key());
+    OSPF::flood_lsa(area, flushed);
+    lsa_flushed++;
+}
+
+bool LSDB::exchanging() const noexcept {
+    for (auto& intf : area->interfaces) {
+        for (auto& nbr : intf->neighbors) {
+            if (nbr->state == Neighbor::State::EXCHANGE || nbr->state == Neighbor::State::LOADING) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void LSDB::discard_rxmt(const LSA::Key& key) noexcept {
+    for (auto& intf : area->interfaces) {
+        for (auto& nbr : intf->neighbors) {
+            nbr->remove_rxmt(key);
+        }
+    }
+}
+
+bool LSDB::in_rxmt(const LSA::Key& key) noexcept {
+    for (auto& intf : area->interfaces) {
+        for (auto& nbr : intf->neighbors) {
+            if (nbr->in_rxmt(key)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// RFC 2328 14：MaxAge的LSA在已被所有邻接确认、且没有邻居处于Exchange/Loading状态时才能删除
+void LSDB::remove_maxage() noexcept {
+    if (maxage_lsas.empty() || exchanging()) {
+        return;
+    }
+    size_t kept = 0;
+    for (auto& change : maxage_lsas) {
+        auto lsa = get(change.type, change.ls_id, change.adv_rtr);
+        // 可能已被较新的实例替换
+        if (lsa == nullptr || !lsa->is_maxage()) {
+            continue;
+        }
+        if (in_rxmt(lsa->header.key())) {
+            maxage_lsas[kept++] = change;
+            continue;
+        }
+        del(change.type, change.ls_id, change.adv_rtr);
+        lsa_removed++;
+    }
+    maxage_lsas.resize(kept);
+}
+
+void LSDB::start_aging() noexcept {
+    this_timers.add(1000, [this] { age_tick(); });
+}
+
+void LSDB::age_tick() noexcept {
+    lock();
+    auto now = LSA::now_seconds();
+    if (now > aging_cursor) {
+        // 定时器可能迟到，补上错过的秒，最多一圈
+        auto from = aging_cursor + 1;
+        if (now - aging_cursor > LSA::MAX_AGE) {
+            from = now - LSA::MAX_AGE + 1;
+        }
+        for (auto sec = from; sec <= now; ++sec) {
+            age_bucket(sec);
+        }
+        aging_cursor = now;
+    }
+    remove_maxage();
+    unlock();
+    this_timers.add(1000, [this] { age_tick(); });
+}
+
+void LSDB::print_stats(std::ostream& os) noexcept {
+    lock();
+    size_t pending = 0;
+    for (auto& bucket : aging_buckets) {
+        pending += bucket.size();
+    }
+    os << "LSDB Statistics (area " << ip_to_str(area->area_id) << "):" << std::endl
+       << "	lsas: " << lsa_num() << std::endl
+       << "	aging entries: " << pending << std::endl
+       << "	maxage pending: " << maxage_lsas.size() << std::endl
+       << "	refreshed: " << lsa_refreshed << std::endl
+       << "	flushed: " << lsa_flushed << std::endl
+       << "	removed: " << lsa_removed << std::endl
+       << "	version: " << version << std::endl
+       << "	snapshots: " << snapshots << std::endl
+       << "	table copies: " << table_copies << std::endl;
+    unlock();
+}
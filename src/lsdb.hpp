@@ -4,59 +4,189 @@
 #include <cassert>
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <netinet/in.h>
+#include <ostream>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "packet.hpp"
+#include "timer.hpp"
 
+class Area;
 class Interface;
 
-class LSDB {
+/*
+ * 同一类型LSA的存储：
+ * - 按(link_state_id, advertising_router)建立哈希索引，查找/插入/替换均为O(1)；
+ * - 另按link_state_id建立二级索引，供路由计算时只知道ls_id的查找使用；
+ * - 遍历顺序即插入顺序，替换时保持原位置，保证SPF结果确定。
+ */
+template <typename T>
+class LSATable {
 public:
-    std::list<RouterLSA *> router_lsas;
-    std::list<NetworkLSA *> network_lsas;
-    std::list<SummaryLSA *> summary_lsas;
-    std::list<ASBRSummaryLSA *> asbr_summary_lsas;
-    std::list<ASExternalLSA *> as_external_lsas;
+    // 表和快照共同持有LSA实例，最后一个持有者放手时才释放
+    using Ptr = std::shared_ptr<T>;
+    using iterator = typename PoolList<Ptr>::iterator;
+    using const_iterator = typename PoolList<Ptr>::const_iterator;
 
-    uint16_t max_age = 3600;     // max time an lsa can survive, default 3600s
-    uint16_t max_age_diff = 900; // max time an lsa flood the AS, default 900s
+    static uint64_t make_key(uint32_t ls_id, uint32_t adv_rtr) noexcept {
+        return (static_cast<uint64_t>(ls_id) << 32) | adv_rtr;
+    }
 
-public:
-    LSDB() noexcept = default;
-    ~LSDB() {
-        for (auto& lsa : router_lsas) {
-            delete lsa;
+    LSATable() = default;
+    /* 复制时重建索引，使其指向新表自己的链表 */
+    LSATable(const LSATable& rhs) {
+        index.reserve(rhs.index.size());
+        id_index.reserve(rhs.id_index.size());
+        for (auto& lsa : rhs.lsas) {
+            append(lsa);
         }
-        for (auto& lsa : network_lsas) {
-            delete lsa;
+    }
+    LSATable& operator=(const LSATable&) = delete;
+
+    T *get(uint32_t ls_id, uint32_t adv_rtr) const noexcept {
+        auto it = index.find(make_key(ls_id, adv_rtr));
+        return it != index.end() ? it->second->get() : nullptr;
+    }
+
+    /* 只按ls_id查找，返回最早插入的那一个 */
+    T *get(uint32_t ls_id) const noexcept {
+        auto it = id_index.find(ls_id);
+        return it != id_index.end() ? it->second.front()->get() : nullptr;
+    }
+
+    /* 返回ls_id相同的所有LSA，按插入顺序 */
+    std::vector<T *> get_all(uint32_t ls_id) const {
+        std::vector<T *> all;
+        auto it = id_index.find(ls_id);
+        if (it != id_index.end()) {
+            for (auto& pos : it->second) {
+                all.push_back(pos->get());
+            }
         }
-        for (auto& lsa : summary_lsas) {
-            delete lsa;
+        return all;
+    }
+
+    /* 插入或原位替换，表接管lsa */
+    void put(T *lsa) {
+        // 控制块同样从内存池分配
+        Ptr ptr(lsa, std::default_delete<T>(), PoolAllocator<T>());
+        auto it = index.find(make_key(lsa->header.link_state_id, lsa->header.advertising_router));
+        if (it != index.end()) {
+            *it->second = std::move(ptr);
+            return;
         }
-        for (auto& lsa : asbr_summary_lsas) {
-            delete lsa;
+        append(ptr);
+    }
+
+    void erase(uint32_t ls_id, uint32_t adv_rtr) noexcept {
+        auto it = index.find(make_key(ls_id, adv_rtr));
+        if (it == index.end()) {
+            return;
         }
-        for (auto& lsa : as_external_lsas) {
-            delete lsa;
+        auto pos = it->second;
+        auto& same_id = id_index[ls_id];
+        same_id.erase(std::find(same_id.begin(), same_id.end(), pos));
+        if (same_id.empty()) {
+            id_index.erase(ls_id);
         }
-        // router_lsas.clear();
-        // network_lsas.clear();
-        // summary_lsas.clear();
-        // asbr_summary_lsas.clear();
-        // as_external_lsas.clear();
+        index.erase(it);
+        lsas.erase(pos);
+    }
+
+    iterator begin() noexcept {
+        return lsas.begin();
+    }
+    iterator end() noexcept {
+        return lsas.end();
+    }
+    const_iterator begin() const noexcept {
+        return lsas.begin();
+    }
+    const_iterator end() const noexcept {
+        return lsas.end();
+    }
+    size_t size() const noexcept {
+        return lsas.size();
     }
+    bool empty() const noexcept {
+        return lsas.empty();
+    }
+
+private:
+    PoolList<Ptr> lsas;
+    PoolMap<uint64_t, iterator> index;
+    std::unordered_map<uint32_t, std::vector<iterator>> id_index;
+
+    void append(const Ptr& lsa) {
+        auto pos = lsas.insert(lsas.end(), lsa);
+        index.emplace(make_key(lsa->header.link_state_id, lsa->header.advertising_router), pos);
+        id_index[lsa->header.link_state_id].push_back(pos);
+    }
+};
+
+class LSDB {
+public:
+    /*
+     * 数据库某一版本的只读视图：
+     * - 各类型的表与数据库共享，数据库写入被快照引用的表前先复制一份（写时复制）；
+     * - LSA实例一经安装不再修改，清除时换上新的实例，因此快照中的LSA可以不加锁读取；
+     * - 持有快照期间，写入方每类表至多复制一次。
+     */
+    struct Snapshot {
+        uint64_t version;
+        std::shared_ptr<const LSATable<RouterLSA>> router_lsas;
+        std::shared_ptr<const LSATable<NetworkLSA>> network_lsas;
+        std::shared_ptr<const LSATable<SummaryLSA>> summary_lsas;
+        std::shared_ptr<const LSATable<ASBRSummaryLSA>> asbr_summary_lsas;
+        std::shared_ptr<const LSATable<ASExternalLSA>> as_external_lsas;
+
+        // 以下供路由计算使用，不返回已清除的LSA
+        RouterLSA *get_router_lsa(uint32_t ls_id) const noexcept;
+        RouterLSA *get_router_lsa(uint32_t ls_id, uint32_t adv_rtr) const noexcept;
+        NetworkLSA *get_network_lsa(uint32_t ls_id) const noexcept;
+        NetworkLSA *get_network_lsa(uint32_t ls_id, uint32_t adv_rtr) const noexcept;
+
+        size_t lsa_num() const noexcept {
+            return router_lsas->size() + network_lsas->size() + summary_lsas->size() + asbr_summary_lsas->size() +
+                   as_external_lsas->size();
+        }
+    };
+
+    uint16_t max_age = LSA::MAX_AGE;           // max time an lsa can survive, default 3600s
+    uint16_t max_age_diff = LSA::MAX_AGE_DIFF; // max time an lsa flood the AS, default 900s
+
+    /* 一条LSA的变化记录（新增、替换或删除） */
+    struct Change {
+        LSA::Type type;
+        uint32_t ls_id;
+        uint32_t adv_rtr;
+    };
+
+public:
+    /* 所属的区域，决定生成LSA时描述哪些接口、在哪些接口上洪泛 */
+    Area *const area;
 
-    RouterLSA *get_router_lsa(uint32_t ls_id);
-    RouterLSA *get_router_lsa(uint32_t ls_id, uint32_t adv_rtr);
-    NetworkLSA *get_network_lsa(uint32_t ls_id);
-    NetworkLSA *get_network_lsa(uint32_t ls_id, uint32_t adv_rtr);
+    explicit LSDB(Area *area) noexcept : area(area) {
+    }
+    ~LSDB() = default;
 
-    void add(LSA::Base *lsa) noexcept;
+    /* 返回数据库中保留的实例：lsa更新则为lsa，否则lsa被释放并返回已有的实例 */
+    /* installed非空时写入lsa是否被安装 */
+    LSA::Base *add(LSA::Base *lsa, bool *installed = nullptr) noexcept;
     void del(LSA::Type type, uint32_t ls_id, uint32_t adv_rtr) noexcept;
     LSA::Base *get(LSA::Type type, uint32_t ls_id, uint32_t adv_rtr) noexcept;
 
+    /* 取出自上次调用以来的变化记录，由调用者保证已锁 */
+    std::vector<Change> take_changes() noexcept {
+        std::vector<Change> taken;
+        taken.swap(changes);
+        return taken;
+    }
+
     void lock() noexcept {
         mtx.lock();
     }
@@ -65,26 +195,110 @@ public:
     }
 
     size_t lsa_num() const {
-        return router_lsas.size() + network_lsas.size() + summary_lsas.size();
+        return router_lsas->size() + network_lsas->size() + summary_lsas->size() + asbr_summary_lsas->size() +
+               as_external_lsas->size();
     }
 
+    /* 当前版本的快照，自上次以来没有变化且旧快照仍在使用时返回同一个，由调用者保证已锁 */
+    std::shared_ptr<const Snapshot> snapshot();
+
 private:
+    template <typename T>
+    using Table = std::shared_ptr<LSATable<T>>;
+    Table<RouterLSA> router_lsas = std::make_shared<LSATable<RouterLSA>>();
+    Table<NetworkLSA> network_lsas = std::make_shared<LSATable<NetworkLSA>>();
+    Table<SummaryLSA> summary_lsas = std::make_shared<LSATable<SummaryLSA>>();
+    Table<ASBRSummaryLSA> asbr_summary_lsas = std::make_shared<LSATable<ASBRSummaryLSA>>();
+    Table<ASExternalLSA> as_external_lsas = std::make_shared<LSATable<ASExternalLSA>>();
+
+    std::vector<Change> changes;
+
+    // 每次变化加一
+    uint64_t version = 0;
+    // 最近发布的快照，不延长其生命期，否则每次写入都要复制
+    std::weak_ptr<const Snapshot> published;
+
+    /* 写入前调用：表仍被快照引用时先复制一份 */
+    template <typename T>
+    LSATable<T>& writable(Table<T>& table) {
+        if (table.use_count() > 1) {
+            table = std::make_shared<LSATable<T>>(*table);
+            table_copies++;
+        }
+        return *table;
+    }
+
+    /* 插入或替换，不比较新旧 */
+    void replace(LSA::Base *lsa) noexcept;
+    /* 记录变化并通知路由表SPT已过时 */
+    void mark_changed(LSA::Type type, uint32_t ls_id, uint32_t adv_rtr) noexcept;
+
+    template <typename T>
+    LSA::Base *install(Table<T>& table, T *lsa, bool *installed) noexcept {
+        auto old_lsa = table->get(lsa->header.link_state_id, lsa->header.advertising_router);
+        if (installed != nullptr) {
+            *installed = old_lsa == nullptr || *lsa > *old_lsa;
+        }
+        if (old_lsa != nullptr && !(*lsa > *old_lsa)) {
+            delete lsa;
+            return old_lsa;
+        }
+        writable(table).put(lsa);
+        mark_changed(lsa->header.type, lsa->header.link_state_id, lsa->header.advertising_router);
+        schedule_aging(lsa);
+        if (old_lsa != nullptr) {
+            discard_rxmt(lsa->header.key());
+        }
+        return lsa;
+    }
+
+    /* 老化相关 */
+    // 一条待检查的LSA，以(类型, ls_id, adv_rtr, 序列号)标识，LSA被替换或删除后该记录自然失效
+    struct AgingEntry {
+        uint32_t deadline; // 到期时刻（now_seconds）
+        uint32_t seq;
+        uint32_t ls_id;
+        uint32_t adv_rtr;
+        LSA::Type type;
+    };
+    // 按到期时刻取模MAX_AGE分桶，每秒只检查一个桶，而不是遍历整个LSDB
+    // 他人的LSA在到达MAX_AGE时到期，自己的LSA在LS_REFRESH_TIME时到期
+    std::vector<AgingEntry> aging_buckets[LSA::MAX_AGE];
+    // 已检查到的时刻
+    uint32_t aging_cursor = LSA::now_seconds();
+    // 已清除、等待从LSDB中删除的LSA
+    std::vector<Change> maxage_lsas;
+
+    void schedule_aging(LSA::Base *lsa) noexcept;
+    void age_bucket(uint32_t now) noexcept;
+    void remove_maxage() noexcept;
+    void refresh_lsa(LSA::Base *lsa) noexcept;
+
+    /* 旧实例已被替换，从所有邻居的重传列表中删除（RFC 2328 13(5)） */
+    void discard_rxmt(const LSA::Key& key) noexcept;
+    /* 是否仍在某个邻居的重传列表中 */
+    bool in_rxmt(const LSA::Key& key) noexcept;
+
     std::mutex mtx; // 保护LSDB的互斥锁
 
 public:
     void make_lsa(LSA::Type type, Interface *interface = nullptr) noexcept;
-};
 
-extern LSDB this_lsdb;
+    /* 以年龄为MAX_AGE的副本替换LSA并洪泛，等待确认后从LSDB中删除，由调用者保证已锁 */
+    void flush_lsa(LSA::Base *lsa) noexcept;
+    /* 是否有邻居处于Exchange或Loading状态，此时不能删除MaxAge的LSA */
+    bool exchanging() const noexcept;
 
-static inline void MAKE_ROUTER_LSA(Interface *interface) {
-    this_lsdb.lock();
-    this_lsdb.make_lsa(LSA::Type::ROUTER, interface);
-    this_lsdb.unlock();
-}
+    /* 启动每秒一次的老化检查 */
+    void start_aging() noexcept;
+    void age_tick() noexcept;
 
-static inline void MAKE_NETWORK_LSA(Interface *interface) {
-    this_lsdb.lock();
-    this_lsdb.make_lsa(LSA::Type::NETWORK, interface);
-    this_lsdb.unlock();
-}
\ No newline at end of file
+    /* 老化统计 */
+    uint64_t lsa_refreshed = 0;
+    uint64_t lsa_flushed = 0;
+    uint64_t lsa_removed = 0;
+    /* 快照统计：发布次数和写时复制的表数 */
+    uint64_t snapshots = 0;
+    uint64_t table_copies = 0;
+    void print_stats(std::ostream& os) noexcept;
+};
@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <string>
 #include <thread>
 
 #include <arpa/inet.h>
@@ -14,8 +17,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "area.hpp"
 #include "interface.hpp"
+#include "lsdb.hpp"
 #include "packet.hpp"
+#include "pool.hpp"
 #include "route.hpp"
 #include "transit.hpp"
 #include "utils.hpp"
@@ -26,12 +32,43 @@ void ospf_run();
 int main(int argc, char *argv[]) {
     // parse args
     bool daemon = false;
-    if (argc > 1 && (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "--daemon") == 0)) {
-        daemon = true;
+    bool promisc = false;
+    for (auto i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--daemon") == 0) {
+            daemon = true;
+        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--promisc") == 0) {
+            promisc = true;
+        } else if ((strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--max-paths") == 0) && i + 1 < argc) {
+            this_routing_table.max_paths = std::max(1, atoi(argv[++i]));
+        } else if ((strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--flood-delay") == 0) && i + 1 < argc) {
+            OSPF::flood_delay_ms = std::max(0, atoi(argv[++i]));
+        } else if ((strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--lsr-in-flight") == 0) && i + 1 < argc) {
+            OSPF::lsr_max_in_flight = std::max(0, atoi(argv[++i]));
+        } else if ((strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--area") == 0) && i + 1 < argc) {
+            // <接口名>=<区域>，区域可写为点分形式或整数
+            std::string arg = argv[++i];
+            auto pos = arg.find('=');
+            if (pos == std::string::npos) {
+                std::cerr << "bad area config: " << arg << std::endl;
+                continue;
+            }
+            auto area = arg.substr(pos + 1);
+            interface_areas[arg.substr(0, pos)] = area.find('.') != std::string::npos
+                                                      ? ntohl(inet_addr(area.c_str()))
+                                                      : strtoul(area.c_str(), nullptr, 10);
+        } else if ((strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--spf-threads") == 0) && i + 1 < argc) {
+            this_routing_table.set_spf_threads(std::max(0, atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--full-spf") == 0) {
+            // 关闭增量SPF，总是全量计算
+            this_routing_table.full_spf = true;
+        } else if (strcmp(argv[i], "--verify-spf") == 0) {
+            // 每次增量计算后以全量计算校验
+            this_routing_table.verify_spf = true;
+        }
     }
 
     // init interfaces
-    init_interfaces();
+    init_interfaces(promisc);
 
     if (daemon) {
         // run as daemon
@@ -44,6 +81,9 @@ int main(int argc, char *argv[]) {
 
     // turn off promisc mode
     for (auto intf : this_interfaces) {
+        if (!intf->promisc) {
+            continue;
+        }
         ifreq ifr;
         int fd = socket(AF_INET, SOCK_DGRAM, 0);
         strncpy(ifr.ifr_name, intf->name, IFNAMSIZ);
@@ -113,14 +153,20 @@ void ospf_run() {
     //     perror("recv socket_fd init");
     // }
 
-    std::thread send_thread(OSPF::send_loop);
+    for (auto area : this_areas) {
+        area->lsdb.start_aging();
+    }
+
+    OSPF::open_wakeup();
+    std::thread timer_thread(OSPF::timer_loop);
     std::thread recv_thread(OSPF::recv_loop);
+    std::thread spf_thread(OSPF::spf_loop);
 
     while (true) {
         std::string cmd;
         std::cin >> cmd;
         if (cmd == "exit") {
-            OSPF::running = false;
+            OSPF::stop();
             break;
         }
         if (cmd == "debug") {
@@ -128,10 +174,20 @@ void ospf_run() {
             // this_routing_table.debug(debug_log);
             this_routing_table.debug(std::cout);
         }
+        if (cmd == "stat") {
+            print_interface_stats(std::cout);
+            for (auto area : this_areas) {
+                area->lsdb.print_stats(std::cout);
+            }
+            this_routing_table.print_stats(std::cout);
+            this_pool.print_stats(std::cout);
+        }
     }
 
-    send_thread.join();
+    timer_thread.join();
     recv_thread.join();
+    spf_thread.join();
+    OSPF::close_wakeup();
 
     std::cout << "OSPF send/recv stopped." << std::endl;
 }
\ No newline at end of file
@@ -1,18 +1,202 @@
 #include <cassert>
 #include <iostream>
 
+#include <netinet/ip.h>
+
+#include "area.hpp"
 #include "interface.hpp"
 #include "lsdb.hpp"
 #include "neighbor.hpp"
 #include "route.hpp"
+#include "transit.hpp"
 #include "utils.hpp"
 
 static const char *state_names[]{"DOWN", "ATTEMPT", "INIT", "TWOWAY", "EXSTART", "EXCHANGE", "LOADING", "FULL"};
 
+Neighbor::Neighbor(in_addr_t ip_addr, Interface *interface)
+    : last_dd_data(interface->mtu - sizeof(iphdr)), ip_addr(ip_addr), host_interface(interface) {
+}
+
+Neighbor::~Neighbor() {
+    this_timers.cancel_and_reset(inactivity_timer);
+    this_timers.cancel_and_reset(rxmt_timer);
+    this_timers.cancel_and_reset(lsu_rxmt_timer);
+}
+
+void Neighbor::reset_inactivity_timer() {
+    this_timers.cancel_and_reset(inactivity_timer);
+    inactivity_timer = this_timers.add(host_interface->router_dead_interval * 1000, [this]() {
+        inactivity_timer = 0;
+        if (state != State::DOWN) {
+            event_inactivity_timer();
+        }
+    });
+}
+
+void Neighbor::start_rxmt_timer(uint32_t delay_ms) {
+    if (rxmt_timer != 0) {
+        return;
+    }
+    rxmt_timer = this_timers.add(delay_ms, [this]() {
+        rxmt_timer = 0;
+        if (state < State::EXSTART || state > State::LOADING) {
+            return;
+        }
+        OSPF::send_rxmt(this);
+        start_rxmt_timer(host_interface->rxmt_interval * 1000);
+    });
+}
+
+void Neighbor::add_rxmt(const char *lsa, size_t len) {
+    auto hdr = *reinterpret_cast<const LSA::Header *>(lsa);
+    hdr.network_to_host();
+    std::lock_guard<std::mutex> lock(rxmt_mtx);
+    auto it = rxmt_index.find(hdr.key());
+    if (it != rxmt_index.end()) {
+        link_state_rxmt_list.erase(it->second);
+        rxmt_index.erase(it);
+    }
+    auto pos = link_state_rxmt_list.insert(
+        link_state_rxmt_list.end(), {hdr.key(), hdr.sequence_number, hdr.checksum, hdr.age >= LSA::MAX_AGE,
+                                     TimerWheel::Clock::now(), PoolBytes(lsa, lsa + len)});
+    rxmt_index.emplace(hdr.key(), pos);
+    arm_lsu_rxmt_timer();
+}
+
+bool Neighbor::ack_rxmt(const LSA::Header& hdr) {
+    std::lock_guard<std::mutex> lock(rxmt_mtx);
+    auto it = rxmt_index.find(hdr.key());
+    if (it == rxmt_index.end()) {
+        return false;
+    }
+    // 只有同一实例的确认才有效（RFC 2328 13.7）
+    auto& entry = *it->second;
+    if (entry.seq != hdr.sequence_number || entry.checksum != hdr.checksum ||
+        entry.maxage != (hdr.age >= LSA::MAX_AGE)) {
+        return false;
+    }
+    link_state_rxmt_list.erase(it->second);
+    rxmt_index.erase(it);
+    lsa_acked++;
+    return true;
+}
+
+void Neighbor::remove_rxmt(const LSA::Key& key) {
+    std::lock_guard<std::mutex> lock(rxmt_mtx);
+    auto it = rxmt_index.find(key);
+    if (it != rxmt_index.end()) {
+        link_state_rxmt_list.erase(it->second);
+        rxmt_index.erase(it);
+    }
+}
+
+bool Neighbor::in_rxmt(const LSA::Key& key) {
+    std::lock_guard<std::mutex> lock(rxmt_mtx);
+    return rxmt_index.count(key) != 0;
+}
+
+size_t Neighbor::rxmt_outstanding() {
+    std::lock_guard<std::mutex> lock(rxmt_mtx);
+    return link_state_rxmt_list.size();
+}
+
+void Neighbor::clear_rxmt_list() {
+    std::lock_guard<std::mutex> lock(rxmt_mtx);
+    this_timers.cancel_and_reset(lsu_rxmt_timer);
+    link_state_rxmt_list.clear();
+    rxmt_index.clear();
+}
+
+// 列表按发送时刻排序，只需为第一条计时
+void Neighbor::arm_lsu_rxmt_timer() {
+    if (lsu_rxmt_timer != 0 || link_state_rxmt_list.empty()) {
+        return;
+    }
+    auto due = link_state_rxmt_list.front().sent + std::chrono::seconds(host_interface->rxmt_interval);
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(due - TimerWheel::Clock::now()).count();
+    lsu_rxmt_timer = this_timers.add(delay > 0 ? delay : 0, [this]() {
+        std::lock_guard<std::mutex> lock(rxmt_mtx);
+        lsu_rxmt_timer = 0;
+        retransmit_lsas();
+        arm_lsu_rxmt_timer();
+    });
+}
+
+// 直接发给邻居，多条LSA按MTU打包
+void Neighbor::retransmit_lsas() {
+    // 邻接已不存在，不再需要确认
+    if (state < State::EXCHANGE) {
+        link_state_rxmt_list.clear();
+        rxmt_index.clear();
+        return;
+    }
+    auto now = TimerWheel::Clock::now();
+    auto interval = std::chrono::seconds(host_interface->rxmt_interval);
+    OSPF::LSUBuilder builder(host_interface, ip_addr);
+    while (!link_state_rxmt_list.empty() && link_state_rxmt_list.front().sent + interval <= now) {
+        auto& entry = link_state_rxmt_list.front();
+        builder.add(entry.data.data(), entry.data.size());
+        entry.sent = now;
+        lsa_retransmitted++;
+        // 移到队尾，保持按发送时刻排序
+        link_state_rxmt_list.splice(link_state_rxmt_list.end(), link_state_rxmt_list, link_state_rxmt_list.begin());
+    }
+    builder.flush();
+}
+
+void Neighbor::add_request(const LSA::Header& hdr) {
+    std::lock_guard<std::mutex> lock(link_state_request_list_mtx);
+    if (request_index.count(hdr.key())) {
+        return;
+    }
+    auto pos = link_state_request_list.insert(
+        link_state_request_list.end(),
+        {{(uint32_t)hdr.type, hdr.link_state_id, hdr.advertising_router}, false});
+    request_index.emplace(hdr.key(), pos);
+}
+
+bool Neighbor::remove_request(const LSA::Key& key) {
+    std::lock_guard<std::mutex> lock(link_state_request_list_mtx);
+    auto it = request_index.find(key);
+    if (it == request_index.end()) {
+        return false;
+    }
+    auto sent = it->second->sent;
+    link_state_request_list.erase(it->second);
+    request_index.erase(it);
+    if (!sent) {
+        return false;
+    }
+    lsr_in_flight--;
+    return lsr_in_flight == 0;
+}
+
+size_t Neighbor::request_outstanding() {
+    std::lock_guard<std::mutex> lock(link_state_request_list_mtx);
+    return link_state_request_list.size();
+}
+
+bool Neighbor::request_list_empty() {
+    std::lock_guard<std::mutex> lock(link_state_request_list_mtx);
+    return link_state_request_list.empty();
+}
+
+void Neighbor::clear_request_list() {
+    std::lock_guard<std::mutex> lock(link_state_request_list_mtx);
+    link_state_request_list.clear();
+    request_index.clear();
+    lsr_in_flight = 0;
+}
+
+void Neighbor::clear_db_summary_list() {
+    db_summary_list.clear();
+    db_summary_snapshot.reset();
+}
+
 void Neighbor::event_hello_received() {
     // assert(state == State::DOWN || state == State::ATTEMPT || state == State::INIT);
+    reset_inactivity_timer();
     if (state >= State::INIT) {
-        inactivity_timer = 40;
         return;
     }
 
@@ -23,7 +207,6 @@ void Neighbor::event_hello_received() {
     case State::ATTEMPT:
     case State::INIT:
         state = State::INIT;
-        inactivity_timer = 40;
         break;
     default:
         // 如果在Init之上的状态收到Hello，无须操作
@@ -83,6 +266,7 @@ void Neighbor::event_2way_received() {
             state = State::EXSTART;
             dd_seq_num = 0;
             is_master = false;
+            start_rxmt_timer();
             break;
         }
     }
@@ -94,23 +278,25 @@ void Neighbor::event_negotiation_done() {
     std::cout << "Neighbor " << ip_to_str(ip_addr) << " negotiation done:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
     // 初始化dd_summary_list
-    this_lsdb.lock();
-    for (auto& rlsa : this_lsdb.router_lsas) {
-        db_summary_list.push_back(&rlsa->header);
+    auto& lsdb = host_interface->area->lsdb;
+    lsdb.lock();
+    db_summary_snapshot = lsdb.snapshot();
+    lsdb.unlock();
+    for (auto& rlsa : *db_summary_snapshot->router_lsas) {
+        db_summary_list.push_back(rlsa.get());
     }
-    for (auto& nlsa : this_lsdb.network_lsas) {
-        db_summary_list.push_back(&nlsa->header);
+    for (auto& nlsa : *db_summary_snapshot->network_lsas) {
+        db_summary_list.push_back(nlsa.get());
     }
-    for (auto& slsa : this_lsdb.summary_lsas) {
-        db_summary_list.push_back(&slsa->header);
+    for (auto& slsa : *db_summary_snapshot->summary_lsas) {
+        db_summary_list.push_back(slsa.get());
     }
-    for (auto& aslsa : this_lsdb.asbr_summary_lsas) {
-        db_summary_list.push_back(&aslsa->header);
+    for (auto& aslsa : *db_summary_snapshot->asbr_summary_lsas) {
+        db_summary_list.push_back(aslsa.get());
     }
-    for (auto& elsa : this_lsdb.as_external_lsas) {
-        db_summary_list.push_back(&elsa->header);
+    for (auto& elsa : *db_summary_snapshot->as_external_lsas) {
+        db_summary_list.push_back(elsa.get());
     }
-    this_lsdb.unlock();
     state = State::EXCHANGE;
     std::cout << state_names[(int)state] << std::endl;
 }
@@ -119,18 +305,18 @@ void Neighbor::event_exchange_done() {
     assert(state == State::EXCHANGE);
     std::cout << "Neighbor " << ip_to_str(ip_addr) << " exchange done:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
+    // 摘要已全部发出
+    clear_db_summary_list();
     // state = State::LOADING;
-    link_state_request_list_mtx.lock();
-    if (link_state_request_list.empty()) {
+    if (request_list_empty()) {
         state = State::FULL;
-        MAKE_ROUTER_LSA(nullptr);
+        MAKE_ROUTER_LSA(host_interface->area);
         if (host_interface->designated_router == host_interface->ip_addr) {
-            MAKE_NETWORK_LSA(host_interface);
+            MAKE_NETWORK_LSA(host_interface->area, host_interface);
         }
     } else {
         state = State::LOADING;
     }
-    link_state_request_list_mtx.unlock();
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -142,9 +328,10 @@ void Neighbor::event_bad_lsreq() {
     state = State::EXSTART;
     dd_seq_num = 0;
     is_master = false;
-    link_state_rxmt_list.clear();
-    db_summary_list.clear();
-    link_state_request_list.clear();
+    start_rxmt_timer();
+    clear_rxmt_list();
+    clear_db_summary_list();
+    clear_request_list();
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -153,7 +340,7 @@ void Neighbor::event_loading_done() {
     std::cout << "Neighbor " << ip_to_str(ip_addr) << " loading done:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
     state = State::FULL;
-    MAKE_ROUTER_LSA(nullptr);
+    MAKE_ROUTER_LSA(host_interface->area);
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -166,6 +353,7 @@ void Neighbor::event_adj_ok() {
             state = State::EXSTART;
             dd_seq_num = 0;
             is_master = false;
+            start_rxmt_timer();
         }
     } else if (state >= State::EXSTART) {
         if (!estab_adj()) {
@@ -182,9 +370,10 @@ void Neighbor::event_seq_number_mismatch() {
     state = State::EXSTART;
     dd_seq_num = 0;
     is_master = false;
-    link_state_rxmt_list.clear();
-    db_summary_list.clear();
-    link_state_request_list.clear();
+    start_rxmt_timer();
+    clear_rxmt_list();
+    clear_db_summary_list();
+    clear_request_list();
     // 重新发空的DD包
     std::cout << state_names[(int)state] << std::endl;
 }
@@ -197,10 +386,9 @@ void Neighbor::event_1way_received() {
     std::cout << "Neighbor " << ip_to_str(ip_addr) << " received 1way:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
     state = State::INIT;
-    inactivity_timer = 40;
-    link_state_rxmt_list.clear();
-    db_summary_list.clear();
-    link_state_request_list.clear();
+    clear_rxmt_list();
+    clear_db_summary_list();
+    clear_request_list();
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -209,10 +397,11 @@ void Neighbor::event_kill_nbr() {
     std::cout << "Neighbor " << ip_to_str(ip_addr) << " kill:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
     state = State::DOWN;
-    inactivity_timer = 0;
-    link_state_rxmt_list.clear();
-    db_summary_list.clear();
-    link_state_request_list.clear();
+    this_timers.cancel_and_reset(inactivity_timer);
+    this_timers.cancel_and_reset(rxmt_timer);
+    clear_rxmt_list();
+    clear_db_summary_list();
+    clear_request_list();
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -220,9 +409,10 @@ void Neighbor::event_inactivity_timer() {
     std::cout << "Neighbor " << ip_to_str(ip_addr) << " inactivity timer:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
     state = State::DOWN;
-    link_state_rxmt_list.clear();
-    db_summary_list.clear();
-    link_state_request_list.clear();
+    this_timers.cancel_and_reset(rxmt_timer);
+    clear_rxmt_list();
+    clear_db_summary_list();
+    clear_request_list();
     std::cout << state_names[(int)state] << std::endl;
 }
 
@@ -230,9 +420,10 @@ void Neighbor::event_ll_down() {
     std::cout << "Neighbor " << ip_to_str(ip_addr) << " ll down:"
               << "\n\tstate " << state_names[(int)state] << " -> ";
     state = State::DOWN;
-    inactivity_timer = 0;
-    link_state_rxmt_list.clear();
-    db_summary_list.clear();
-    link_state_request_list.clear();
+    this_timers.cancel_and_reset(inactivity_timer);
+    this_timers.cancel_and_reset(rxmt_timer);
+    clear_rxmt_list();
+    clear_db_summary_list();
+    clear_request_list();
     std::cout << state_names[(int)state] << std::endl;
 }
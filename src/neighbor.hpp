@@ -3,12 +3,17 @@
 #include <atomic>
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include <netinet/if_ether.h>
 #include <netinet/in.h>
 
+#include "lsdb.hpp"
 #include "packet.hpp"
+#include "timer.hpp"
 
 class Interface;
 
@@ -32,7 +37,7 @@ public:
     } state = State::DOWN;
 
     /* 非活跃计时器 */
-    uint32_t inactivity_timer = 40;
+    TimerWheel::TimerId inactivity_timer = 0;
 
     /* 是否为master */
     bool is_master = false;
@@ -45,7 +50,7 @@ public:
 
     /* 最后一个发出的DD包的长度和数据 */
     uint32_t last_dd_data_len;
-    char last_dd_data[ETH_DATA_LEN];
+    std::vector<char> last_dd_data; // 按接口MTU分配
 
     /* 记录上一次传输的dd包中lsahdr的数量 */
     size_t dd_lsahdr_cnt = 0;
@@ -67,18 +72,49 @@ public:
     Interface *host_interface;
 
     /* 邻居的重传计时器 */
-    uint32_t rxmt_timer = 0;
+    TimerWheel::TimerId rxmt_timer = 0;
 
     /* 需要重传的链路状态数据 */
-    std::list<LSA::Base *> link_state_rxmt_list;
+    struct RxmtEntry {
+        LSA::Key key;
+        uint32_t seq;
+        uint16_t checksum;
+        bool maxage;
+        // 上次发送的时刻，列表按此排序
+        TimerWheel::Clock::time_point sent;
+        // 网络字节序的LSA，洪泛时写出
+        PoolBytes data;
+    };
+    PoolList<RxmtEntry> link_state_rxmt_list;
+    PoolMap<LSA::Key, PoolList<RxmtEntry>::iterator, LSA::KeyHash> rxmt_index;
+    std::mutex rxmt_mtx; // 洪泛、确认和重传分别在不同线程中访问
+    /* LSU重传计时器 */
+    TimerWheel::TimerId lsu_rxmt_timer = 0;
+
+    /* 重传统计 */
+    uint64_t lsa_retransmitted = 0;
+    uint64_t lsa_acked = 0;
+    /* 发出的LSR报文数 */
+    uint64_t lsr_sent = 0;
 
     /* Exchange状态下的链路状态数据 */
-    std::list<LSA::Header *> db_summary_list; // 不会被同时访问，不需要加锁（大概）
-    std::list<LSA::Header *>::iterator db_summary_send_iter;
+    PoolList<LSA::Base *> db_summary_list; // 不会被同时访问，不需要加锁（大概）
+    PoolList<LSA::Base *>::iterator db_summary_send_iter;
+    // 摘要取自进入Exchange时的快照，其间LSDB的替换和删除不会使列表中的指针失效
+    std::shared_ptr<const LSDB::Snapshot> db_summary_snapshot;
 
     /* Exchange和Loading状态下需要请求的链路状态数据 */
-    std::list<OSPF::LSR::Request> link_state_request_list;
+    // 按加入顺序排列，并按LSA标识建立索引，收到LSA时O(1)删除
+    // 已发出而未收到的请求总在列表前部
+    struct RequestEntry {
+        OSPF::LSR::Request req;
+        bool sent;
+    };
+    PoolList<RequestEntry> link_state_request_list;
+    PoolMap<LSA::Key, PoolList<RequestEntry>::iterator, LSA::KeyHash> request_index;
     std::mutex link_state_request_list_mtx; // 因为exchange阶段就在发lsr了，会被同时访问
+    // 已发出而未收到的请求数
+    size_t lsr_in_flight = 0;
 
     /* Exchange和Loading状态下收到的链路状态请求，准备用于lsu中发送 */
     std::list<LSA::Base *> lsa_update_list;
@@ -90,11 +126,8 @@ public:
     bool dd_init = true;
 
 public:
-    Neighbor(in_addr_t ip_addr, Interface *interface) : ip_addr(ip_addr), host_interface(interface) {
-        // dd_rtmx = false;
-        // dd_ack = false;
-    }
-    ~Neighbor() = default;
+    Neighbor(in_addr_t ip_addr, Interface *interface);
+    ~Neighbor();
 
 public:
     void event_hello_received();
@@ -111,6 +144,34 @@ public:
     void event_inactivity_timer();
     void event_ll_down();
 
+    /* 在Exstart、Exchange和Loading状态下每rxmt_interval秒重传DD/LSR，已启动时不重复启动 */
+    void start_rxmt_timer(uint32_t delay_ms = 0);
+
+    /* 向邻居洪泛了一条LSA（网络字节序），加入重传列表，同一LSA的旧实例被替换 */
+    void add_rxmt(const char *lsa, size_t len);
+    /* 收到确认（或隐含确认），若是重传列表中的同一实例则删除，hdr为主机字节序 */
+    bool ack_rxmt(const LSA::Header& hdr);
+    /* 删除某一LSA的任何实例，如收到了更新的实例 */
+    void remove_rxmt(const LSA::Key& key);
+    bool in_rxmt(const LSA::Key& key);
+    size_t rxmt_outstanding();
+    void clear_rxmt_list();
+
+    /* 加入请求列表，已在列表中时忽略，hdr为主机字节序 */
+    void add_request(const LSA::Header& hdr);
+    /* 收到LSA后删除对应的请求，已发出的请求全部收到时返回true */
+    bool remove_request(const LSA::Key& key);
+    bool request_list_empty();
+    size_t request_outstanding();
+    void clear_request_list();
+    /* 清空数据库摘要列表并放开快照 */
+    void clear_db_summary_list();
+
 private:
     bool estab_adj() noexcept;
+    /* 收到Hello后重新开始计时，router_dead_interval秒内未再收到则触发inactivity_timer事件 */
+    void reset_inactivity_timer();
+    /* 重传超过rxmt_interval未被确认的LSA，并为剩下最早的一条重新计时，由调用者保证已锁rxmt_mtx */
+    void retransmit_lsas();
+    void arm_lsu_rxmt_timer();
 };
\ No newline at end of file
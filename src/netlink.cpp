@@ -0,0 +1,261 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "netlink.hpp"
+
+// 单次sendmsg的最大长度，需小于套接字发送缓冲区
+static constexpr size_t NL_BATCH_SIZE = 32 * 1024;
+static constexpr size_t NL_RECV_SIZE = 32 * 1024;
+
+NetlinkRoute::~NetlinkRoute() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool NetlinkRoute::open() {
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        perror("open netlink socket failed");
+        return false;
+    }
+    // 大量路由失败时错误回报较多
+    int rcvbuf = 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind netlink socket failed");
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    buf.reserve(NL_BATCH_SIZE + 256);
+    return true;
+}
+
+static void add_attr(std::vector<char>& buf, int type, const void *data, int len) {
+    auto attr_len = RTA_LENGTH(len);
+    auto off = buf.size();
+    buf.resize(off + RTA_ALIGN(attr_len));
+    auto rta = (rtattr *)(buf.data() + off);
+    rta->rta_type = type;
+    rta->rta_len = attr_len;
+    memcpy(RTA_DATA(rta), data, len);
+}
+
+void NetlinkRoute::append(int type, int flags, in_addr_t dst, in_addr_t mask, const std::vector<Nexthop>& nexthops,
+                          uint32_t metric) {
+    if (buf.size() >= NL_BATCH_SIZE) {
+        send_batch();
+    }
+
+    auto direct = nexthops.size() == 1 && nexthops[0].first == 0;
+    auto start = buf.size();
+    buf.resize(start + NLMSG_SPACE(sizeof(rtmsg)));
+    auto nlh = (nlmsghdr *)(buf.data() + start);
+    memset(nlh, 0, NLMSG_SPACE(sizeof(rtmsg)));
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+    nlh->nlmsg_seq = ++seq;
+
+    auto rtm = (rtmsg *)NLMSG_DATA(nlh);
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = __builtin_popcount(mask);
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_protocol = RTPROT_OSPF;
+    rtm->rtm_scope = direct ? RT_SCOPE_LINK : RT_SCOPE_UNIVERSE;
+    rtm->rtm_type = RTN_UNICAST;
+
+    // 属性追加可能使buf重新分配，nlh需在最后重新取
+    auto net_dst = htonl(dst);
+    add_attr(buf, RTA_DST, &net_dst, sizeof(net_dst));
+    add_attr(buf, RTA_PRIORITY, &metric, sizeof(metric));
+    if (nexthops.size() == 1) {
+        if (!direct) {
+            auto net_gw = htonl(nexthops[0].first);
+            add_attr(buf, RTA_GATEWAY, &net_gw, sizeof(net_gw));
+        }
+        add_attr(buf, RTA_OIF, &nexthops[0].second, sizeof(int));
+    } else if (nexthops.size() > 1) {
+        // RTA_MULTIPATH内为连续的rtnexthop，每个后接自己的RTA_GATEWAY
+        auto mp_off = buf.size();
+        buf.resize(mp_off + RTA_LENGTH(0));
+        for (auto& nexthop : nexthops) {
+            auto nh_off = buf.size();
+            buf.resize(nh_off + RTNH_ALIGN(sizeof(rtnexthop)));
+            auto rtnh = (rtnexthop *)(buf.data() + nh_off);
+            memset(rtnh, 0, sizeof(rtnexthop));
+            rtnh->rtnh_ifindex = nexthop.second;
+            auto net_gw = htonl(nexthop.first);
+            add_attr(buf, RTA_GATEWAY, &net_gw, sizeof(net_gw));
+            rtnh = (rtnexthop *)(buf.data() + nh_off);
+            rtnh->rtnh_len = buf.size() - nh_off;
+        }
+        auto mp = (rtattr *)(buf.data() + mp_off);
+        mp->rta_type = RTA_MULTIPATH;
+        mp->rta_len = buf.size() - mp_off;
+    }
+
+    nlh = (nlmsghdr *)(buf.data() + start);
+    nlh->nlmsg_len = buf.size() - start;
+    msgs_sent++;
+}
+
+void NetlinkRoute::add(in_addr_t dst, in_addr_t mask, const std::vector<Nexthop>& nexthops, uint32_t metric,
+                       uint64_t tag) {
+    // 同一(dst, metric)的路由直接替换
+    append(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE, dst, mask, nexthops, metric);
+    pending.emplace_back(seq, tag);
+}
+
+void NetlinkRoute::del(in_addr_t dst, in_addr_t mask, const std::vector<Nexthop>& nexthops, uint32_t metric) {
+    append(RTM_DELROUTE, 0, dst, mask, nexthops, metric);
+}
+
+void NetlinkRoute::send_batch() {
+    if (buf.empty()) {
+        return;
+    }
+    sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    iovec iov = {buf.data(), buf.size()};
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &addr;
+    msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (sendmsg(fd, &msg, 0) < 0) {
+        perror("send netlink batch failed");
+        errors++;
+    }
+    batches_sent++;
+    buf.clear();
+}
+
+// 未设置NLM_F_ACK，内核只回报失败的消息
+// 内核在sendmsg返回前已处理完整批消息，此处非阻塞读取即可
+void NetlinkRoute::recv_errors(std::vector<uint64_t>& failed) {
+    char rbuf[NL_RECV_SIZE];
+    while (true) {
+        auto len = recv(fd, rbuf, sizeof(rbuf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("recv netlink failed");
+            }
+            break;
+        }
+        for (auto nlh = (nlmsghdr *)rbuf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type != NLMSG_ERROR) {
+                continue;
+            }
+            auto err = (nlmsgerr *)NLMSG_DATA(nlh);
+            if (err->error == 0) {
+                continue;
+            }
+            errors++;
+            auto rtm = (rtmsg *)NLMSG_DATA(&err->msg);
+            std::cerr << "netlink route error: " << strerror(-err->error) << " (seq " << nlh->nlmsg_seq
+                      << ", dst_len " << (int)rtm->rtm_dst_len << ")" << std::endl;
+            for (auto& p : pending) {
+                if (p.first == nlh->nlmsg_seq) {
+                    failed.push_back(p.second);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+std::vector<uint64_t> NetlinkRoute::flush() {
+    std::vector<uint64_t> failed;
+    if (fd < 0) {
+        return failed;
+    }
+    send_batch();
+    recv_errors(failed);
+    pending.clear();
+    return failed;
+}
+
+// dump主表，将其中protocol为RTPROT_OSPF的路由改写为RTM_DELROUTE批量发出
+void NetlinkRoute::purge() {
+    if (fd < 0) {
+        return;
+    }
+    struct {
+        nlmsghdr nlh;
+        rtmsg rtm;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(rtmsg));
+    req.nlh.nlmsg_type = RTM_GETROUTE;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++seq;
+    req.rtm.rtm_family = AF_INET;
+    if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+        perror("dump kernel routes failed");
+        return;
+    }
+
+    std::vector<char> dels;
+    char rbuf[NL_RECV_SIZE];
+    bool done = false;
+    while (!done) {
+        auto len = recv(fd, rbuf, sizeof(rbuf), 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("recv kernel routes failed");
+            break;
+        }
+        for (auto nlh = (nlmsghdr *)rbuf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_DONE || nlh->nlmsg_type == NLMSG_ERROR) {
+                done = true;
+                break;
+            }
+            auto rtm = (rtmsg *)NLMSG_DATA(nlh);
+            if (nlh->nlmsg_type != RTM_NEWROUTE || rtm->rtm_protocol != RTPROT_OSPF ||
+                rtm->rtm_table != RT_TABLE_MAIN) {
+                continue;
+            }
+            auto off = dels.size();
+            dels.insert(dels.end(), (char *)nlh, (char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+            auto del = (nlmsghdr *)(dels.data() + off);
+            del->nlmsg_type = RTM_DELROUTE;
+            del->nlmsg_flags = NLM_F_REQUEST;
+            del->nlmsg_seq = ++seq;
+            del->nlmsg_pid = 0;
+        }
+    }
+
+    // 按批次发出
+    size_t count = 0;
+    for (size_t off = 0; off < dels.size();) {
+        auto nlh = (nlmsghdr *)(dels.data() + off);
+        auto msg_len = NLMSG_ALIGN(nlh->nlmsg_len);
+        if (buf.size() + msg_len > NL_BATCH_SIZE) {
+            send_batch();
+        }
+        buf.insert(buf.end(), dels.data() + off, dels.data() + off + msg_len);
+        msgs_sent++;
+        off += msg_len;
+        count++;
+    }
+    flush();
+    if (count > 0) {
+        std::cout << "purged " << count << " stale ospf routes" << std::endl;
+    }
+}
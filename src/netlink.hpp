@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+
+#ifndef RTPROT_OSPF
+#define RTPROT_OSPF 188
+#endif
+
+// rtnetlink路由写入
+// 多条RTM_NEWROUTE/RTM_DELROUTE消息打包在一次sendmsg中发出，不逐条等待ACK
+// 写入的路由protocol均为RTPROT_OSPF，进程异常退出后可据此清理
+class NetlinkRoute {
+public:
+    NetlinkRoute() = default;
+    ~NetlinkRoute();
+
+    /* 打开netlink套接字，失败时返回false */
+    bool open();
+    bool is_open() const noexcept {
+        return fd >= 0;
+    }
+
+    /* 下一跳地址（直连为0）和接口index */
+    using Nexthop = std::pair<in_addr_t, int>;
+
+    /* 追加一条消息到缓冲区，tag在该消息失败时由flush返回 */
+    /* 多于一个下一跳时以RTA_MULTIPATH写入等价多路径 */
+    void add(in_addr_t dst, in_addr_t mask, const std::vector<Nexthop>& nexthops, uint32_t metric, uint64_t tag);
+    void del(in_addr_t dst, in_addr_t mask, const std::vector<Nexthop>& nexthops, uint32_t metric);
+    /* 发出缓冲区中的消息，返回失败的add对应的tag */
+    std::vector<uint64_t> flush();
+    /* 删除内核中所有RTPROT_OSPF路由 */
+    void purge();
+
+    /* 统计 */
+    uint64_t msgs_sent = 0;
+    uint64_t batches_sent = 0;
+    uint64_t errors = 0;
+
+private:
+    int fd = -1;
+    uint32_t seq = 0;
+    std::vector<char> buf;
+    // 请求了回报的消息：(seq, tag)
+    std::vector<std::pair<uint32_t, uint64_t>> pending;
+
+    void append(int type, int flags, in_addr_t dst, in_addr_t mask, const std::vector<Nexthop>& nexthops,
+                uint32_t metric);
+    void send_batch();
+    void recv_errors(std::vector<uint64_t>& failed);
+};
@@ -1,8 +1,10 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <mutex>
 #include <thread>
 
 #include <arpa/inet.h>
@@ -13,16 +15,20 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "area.hpp"
 #include "interface.hpp"
 #include "lsdb.hpp"
 #include "neighbor.hpp"
 #include "route.hpp"
+#include "timer.hpp"
 #include "transit.hpp"
 
 namespace OSPF {
 
-// constexpr size_t dd_max_lsahdr_num = (ETH_DATA_LEN - sizeof(OSPF::Header) - sizeof(OSPF::DD)) / sizeof(LSA::Header);
-constexpr size_t dd_max_lsahdr_num = 10ul;
+// 一个DD包最多能装下的LSA头部数量，由接口MTU决定
+static size_t dd_max_lsahdr_num(Interface *intf) {
+    return (intf->mtu - sizeof(iphdr) - sizeof(OSPF::Header) - sizeof(OSPF::DD)) / sizeof(LSA::Header);
+}
 
 // 发送IP包，包含OSPF报文
 void send_packet(Interface *intf, char *packet, size_t len, OSPF::Type type, in_addr_t dst) {
@@ -58,6 +64,37 @@ void send_packet(Interface *intf, char *packet, size_t len, OSPF::Type type, in_
     }
 }
 
+bool verify_packet(const char *packet, size_t len) {
+    if (len < sizeof(OSPF::Header)) {
+        return false;
+    }
+    auto ospf_hdr = reinterpret_cast<const OSPF::Header *>(packet);
+    auto length = ntohs(ospf_hdr->length);
+    if (length < sizeof(OSPF::Header) || length > len) {
+        return false;
+    }
+    // 密码认证时不计算校验和（RFC 2328 D.4.3）
+    if (ntohs(ospf_hdr->auth_type) == 2) {
+        return true;
+    }
+    // 校验和覆盖除认证字段外的整个报文
+    auto sum = inet_sum(packet, offsetof(OSPF::Header, auth));
+    sum = inet_sum(packet + sizeof(OSPF::Header), length - sizeof(OSPF::Header), sum);
+    return inet_fold(sum) == 0;
+}
+
+bool verify_lsa(const char *lsa, size_t len) {
+    if (len < sizeof(LSA::Header)) {
+        return false;
+    }
+    auto length = ntohs(reinterpret_cast<const LSA::Header *>(lsa)->length);
+    if (length < sizeof(LSA::Header) || length > len) {
+        return false;
+    }
+    // 校验和覆盖除年龄外的整个LSA
+    return fletcher16_verify(lsa + 2, length - 2);
+}
+
 size_t produce_hello(Interface *intf, char *body) {
     auto hello = reinterpret_cast<OSPF::Hello *>(body);
     hello->network_mask = intf->mask;
@@ -139,7 +176,7 @@ void process_hello(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
 size_t produce_dd(char *body, Neighbor *nbr) {
     auto dd = reinterpret_cast<OSPF::DD *>(body);
     size_t dd_len;
-    dd->interface_mtu = ETH_DATA_LEN;
+    dd->interface_mtu = nbr->host_interface->mtu;
     dd->options = 0x02;
     dd->sequence_number = nbr->dd_seq_num;
     dd->flags = 0;
@@ -154,29 +191,25 @@ size_t produce_dd(char *body, Neighbor *nbr) {
     if (nbr->dd_init) {
         dd->host_to_network(0);
     } else {
+        // 已确认的部分在收到回复时删除，因此总是从头开始发送
+        auto max_num = dd_max_lsahdr_num(nbr->host_interface);
+        auto num = std::min(max_num, nbr->db_summary_list.size());
         auto lsahdr = dd->lsahdrs;
-        if (nbr->db_summary_list.size() > dd_max_lsahdr_num) {
-            std::advance(nbr->db_summary_send_iter, dd_max_lsahdr_num);
+        nbr->db_summary_send_iter = nbr->db_summary_list.begin();
+        for (size_t i = 0; i < num; ++i, ++nbr->db_summary_send_iter) {
+            *lsahdr = (*nbr->db_summary_send_iter)->header;
+            lsahdr->age = (*nbr->db_summary_send_iter)->current_age();
+            lsahdr++;
+        }
+        dd_len += sizeof(LSA::Header) * num;
+        dd->host_to_network(num);
+        if (nbr->db_summary_list.size() > max_num) {
             dd->flags |= DD_FLAG_M;
-            for (auto it = nbr->db_summary_list.begin(); it != nbr->db_summary_send_iter; ++it) {
-                memcpy(lsahdr, *it, sizeof(LSA::Header));
-                lsahdr++;
-            }
-            dd_len += sizeof(LSA::Header) * dd_max_lsahdr_num;
-            dd->host_to_network(dd_max_lsahdr_num);
         } else {
             // 本次发送剩下所有lsahdr
-            nbr->db_summary_send_iter = nbr->db_summary_list.end();
-            for (auto it = nbr->db_summary_list.begin(); it != nbr->db_summary_list.end(); ++it) {
-                memcpy(lsahdr, *it, sizeof(LSA::Header));
-                lsahdr++;
-            }
-            dd_len += sizeof(LSA::Header) * nbr->db_summary_list.size();
-            dd->host_to_network(nbr->db_summary_list.size());
             // 如果slave已收到!M的包，而且无lsahdr需要发送
             if (nbr->is_master && nbr->dd_recv_no_more) {
                 nbr->event_exchange_done();
-                nbr->db_summary_list.clear();
             }
         }
     }
@@ -191,6 +224,13 @@ void process_dd(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
     assert(nbr != nullptr);
     ospf_dd->network_to_host();
 
+    // 邻居的MTU比本接口大，其DD包可能无法不分片地接收（RFC 2328 10.6）
+    if (ospf_dd->interface_mtu > intf->mtu) {
+        std::cout << "Neighbor " << ip_to_str(src_ip) << " DD rejected: mtu " << ospf_dd->interface_mtu << " > "
+                  << intf->mtu << std::endl;
+        return;
+    }
+
     bool dup = nbr->recv_dd_seq_num == ospf_dd->sequence_number;
     nbr->recv_dd_seq_num = ospf_dd->sequence_number;
 
@@ -228,8 +268,8 @@ void process_dd(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
             // 2. 序列号为邻居的dd_seq_num
             // 3. 包含lsahdr
             // 此时已经是exchange状态，这很重要
-            nbr->last_dd_data_len = produce_dd(nbr->last_dd_data + sizeof(OSPF::Header), nbr);
-            send_packet(intf, nbr->last_dd_data, nbr->last_dd_data_len, OSPF::Type::DD, nbr->ip_addr);
+            nbr->last_dd_data_len = produce_dd(nbr->last_dd_data.data() + sizeof(OSPF::Header), nbr);
+            send_packet(intf, nbr->last_dd_data.data(), nbr->last_dd_data_len, OSPF::Type::DD, nbr->ip_addr);
             return;
         }
         // 如果是master，这里收到dd包必然不为空
@@ -240,7 +280,7 @@ void process_dd(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
         if (dup) {
             if (nbr->is_master) {
                 // slave需要重传上一个包，master的重传通过计时器实现
-                send_packet(intf, nbr->last_dd_data, nbr->last_dd_data_len, OSPF::Type::DD, nbr->ip_addr);
+                send_packet(intf, nbr->last_dd_data.data(), nbr->last_dd_data_len, OSPF::Type::DD, nbr->ip_addr);
             }
             return;
         } else {
@@ -287,7 +327,7 @@ void process_dd(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
         }
         // slave收到重复的DD包
         if (nbr->is_master && dup) {
-            send_packet(intf, nbr->last_dd_data, nbr->last_dd_data_len, OSPF::Type::DD, nbr->ip_addr);
+            send_packet(intf, nbr->last_dd_data.data(), nbr->last_dd_data_len, OSPF::Type::DD, nbr->ip_addr);
             return;
         }
         break;
@@ -302,21 +342,27 @@ void process_dd(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
         // 收到了!M的DD包
         nbr->dd_recv_no_more = !(ospf_dd->flags & DD_FLAG_M);
 
-        // 将收到的lsahdr加入link_state_request_list
+        // 数据库中没有或较旧的LSA加入link_state_request_list（RFC 2328 10.6）
         auto num_lsahdrs = (ospf_hdr->length - sizeof(OSPF::Header) - sizeof(OSPF::DD)) / sizeof(LSA::Header);
         LSA::Header *lsahdr = ospf_dd->lsahdrs;
+        auto& lsdb = intf->area->lsdb;
+        lsdb.lock();
         for (auto i = 0; i < num_lsahdrs; ++i) {
             lsahdr->network_to_host();
-            nbr->link_state_request_list_mtx.lock();
-            this_lsdb.lock();
-            if (this_lsdb.get(lsahdr->type, lsahdr->link_state_id, lsahdr->advertising_router) == nullptr) {
-                nbr->link_state_request_list.push_back(
-                    {(uint32_t)lsahdr->type, lsahdr->link_state_id, lsahdr->advertising_router});
+            auto lsa = lsdb.get(lsahdr->type, lsahdr->link_state_id, lsahdr->advertising_router);
+            if (lsa == nullptr || lsa->header.sequence_number < lsahdr->sequence_number) {
+                nbr->add_request(*lsahdr);
             }
-            this_lsdb.unlock();
-            nbr->link_state_request_list_mtx.unlock();
             lsahdr++;
         }
+        lsdb.unlock();
+        // 没有已发出的请求时立即请求，不必等待重传计时器
+        nbr->link_state_request_list_mtx.lock();
+        auto idle = nbr->lsr_in_flight == 0;
+        nbr->link_state_request_list_mtx.unlock();
+        if (idle) {
+            send_lsr(nbr);
+        }
 
         // 从本质上说，master和slave都需要立即回复
         // master需要在此处完成exchange_done事件
@@ -326,33 +372,55 @@ void process_dd(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
                 return;
             }
         }
-        nbr->last_dd_data_len = produce_dd(nbr->last_dd_data + sizeof(OSPF::Header), nbr);
-        send_packet(intf, nbr->last_dd_data, nbr->last_dd_data_len, OSPF::Type::DD, nbr->ip_addr);
+        nbr->last_dd_data_len = produce_dd(nbr->last_dd_data.data() + sizeof(OSPF::Header), nbr);
+        send_packet(intf, nbr->last_dd_data.data(), nbr->last_dd_data_len, OSPF::Type::DD, nbr->ip_addr);
     }
 }
 
-size_t produce_lsr(char *body, Neighbor *nbr) {
-    // 一次性发完得了...
+uint32_t lsr_max_in_flight = 0;
+
+size_t produce_lsr(char *body, const OSPF::LSR::Request *reqs, size_t num) {
     auto lsr = reinterpret_cast<OSPF::LSR *>(body);
-    auto lsr_req = lsr->reqs;
+    memcpy(lsr->reqs, reqs, sizeof(OSPF::LSR::Request) * num);
+    lsr->host_to_network(num);
+    return sizeof(OSPF::LSR::Request) * num;
+}
+
+void send_lsr(Neighbor *nbr) {
+    auto intf = nbr->host_interface;
+    // 一个LSR报文最多容纳的请求数
+    auto per_packet = (intf->mtu - sizeof(iphdr) - sizeof(OSPF::Header)) / sizeof(OSPF::LSR::Request);
+    auto limit = lsr_max_in_flight == 0 ? per_packet : lsr_max_in_flight;
+
+    // 从列表前部取出请求，包括未收到回复需要重传的请求
+    std::vector<OSPF::LSR::Request> reqs;
     nbr->link_state_request_list_mtx.lock();
-    if (nbr->link_state_request_list.empty()) {
-        nbr->link_state_request_list_mtx.unlock();
-        // 如果时loading状态且已经没有请求，触发loading_done事件
+    for (auto& entry : nbr->link_state_request_list) {
+        if (reqs.size() == limit) {
+            break;
+        }
+        entry.sent = true;
+        reqs.push_back(entry.req);
+    }
+    nbr->lsr_in_flight = reqs.size();
+    nbr->link_state_request_list_mtx.unlock();
+
+    if (reqs.empty()) {
+        // 如果是loading状态且已经没有请求，触发loading_done事件
         if (nbr->state == Neighbor::State::LOADING) {
             nbr->event_loading_done();
-            this_routing_table.update_route();
+            this_routing_table.schedule_spf();
         }
-        return 0;
+        return;
     }
-    for (auto& req : nbr->link_state_request_list) {
-        memcpy(lsr_req, &req, sizeof(OSPF::LSR::Request));
-        lsr_req++;
+
+    std::vector<char> data(sizeof(OSPF::Header) + sizeof(OSPF::LSR::Request) * per_packet);
+    for (size_t i = 0; i < reqs.size(); i += per_packet) {
+        auto num = std::min(per_packet, reqs.size() - i);
+        auto len = produce_lsr(data.data() + sizeof(OSPF::Header), reqs.data() + i, num);
+        send_packet(intf, data.data(), len, OSPF::Type::LSR, nbr->ip_addr);
+        nbr->lsr_sent++;
     }
-    lsr->host_to_network(nbr->link_state_request_list.size());
-    auto len = sizeof(OSPF::LSR::Request) * nbr->link_state_request_list.size();
-    nbr->link_state_request_list_mtx.unlock();
-    return len;
 }
 
 void process_lsr(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
@@ -369,36 +437,73 @@ void process_lsr(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
 
     auto req = ospf_lsr->reqs;
     auto req_end = reinterpret_cast<decltype(req)>(ospf_packet + ospf_hdr->length);
-    char lsu_data[ETH_DATA_LEN];
-    std::list<LSA::Base *> lsa_update_list;
-    this_lsdb.lock();
+    // 按MTU回复一个或多个LSU，在持锁期间写出，避免LSA被替换后失效
+    LSUBuilder builder(intf, src_ip);
+    auto& lsdb = intf->area->lsdb;
+    lsdb.lock();
     while (req != req_end) {
         req->network_to_host();
-        auto lsa = this_lsdb.get_router_lsa(req->link_state_id, req->advertising_router);
+        auto lsa = lsdb.get(static_cast<LSA::Type>(req->ls_type), req->link_state_id, req->advertising_router);
         if (lsa == nullptr) {
+            lsdb.unlock();
             nbr->event_bad_lsreq();
+            return;
         }
-        lsa_update_list.push_back(lsa);
+        builder.add(lsa);
         req++;
     }
-    this_lsdb.unlock();
+    builder.flush();
+    lsdb.unlock();
+}
 
-    // 立即回复LSU（其实可以给发send线程一个信号来处理，可以避免一次数组的分配）
-    auto len = produce_lsu(lsu_data + sizeof(OSPF::Header), lsa_update_list);
-    send_packet(intf, lsu_data, len, OSPF::Type::LSU, src_ip);
+size_t produce_lsa(char *dst, const LSA::Base *lsa) {
+    lsa->to_packet(dst); // 此处已经转化为网络字节序
+    // 每次传输，年龄增加InfTransDelay
+    auto lsahdr = reinterpret_cast<LSA::Header *>(dst);
+    lsahdr->age = htons(std::min<uint16_t>(ntohs(lsahdr->age) + LSA::INF_TRANS_DELAY, LSA::MAX_AGE));
+    return lsa->size();
 }
 
-size_t produce_lsu(char *body, const std::list<LSA::Base *>& lsa_update_list) {
-    auto lsu = reinterpret_cast<OSPF::LSU *>(body);
-    lsu->num_lsas = 0;
-    size_t offset = sizeof(OSPF::LSU);
-    for (auto& lsa : lsa_update_list) {
-        lsa->to_packet(body + offset); // 此处已经转化为网络字节序
-        lsu->num_lsas += 1;
-        offset += lsa->size();
+LSUBuilder::LSUBuilder(Interface *intf, in_addr_t dst) : intf(intf), dst(dst) {
+    // 原始套接字由内核添加IP头部
+    limit = intf->mtu - sizeof(iphdr);
+    len = sizeof(OSPF::Header) + sizeof(OSPF::LSU);
+}
+
+char *LSUBuilder::reserve(size_t lsa_len) {
+    if (num_lsas > 0 && len + lsa_len > limit) {
+        flush();
+    }
+    // 缓冲区在第一次添加时才分配，多数处理LSU时构造的回复不会用到
+    if (buf.size() < len + lsa_len) {
+        buf.resize(std::max(limit, len + lsa_len));
     }
+    auto pos = buf.data() + len;
+    len += lsa_len;
+    num_lsas++;
+    return pos;
+}
+
+void LSUBuilder::add(const LSA::Base *lsa) {
+    produce_lsa(reserve(lsa->size()), lsa);
+}
+
+void LSUBuilder::add(const char *lsa, size_t lsa_len) {
+    memcpy(reserve(lsa_len), lsa, lsa_len);
+}
+
+void LSUBuilder::flush() {
+    if (num_lsas == 0) {
+        return;
+    }
+    auto lsu = reinterpret_cast<OSPF::LSU *>(buf.data() + sizeof(OSPF::Header));
+    lsu->num_lsas = num_lsas;
     lsu->host_to_network();
-    return offset;
+    send_packet(intf, buf.data(), len - sizeof(OSPF::Header), OSPF::Type::LSU, dst);
+    intf->tx_lsu_packets++;
+    intf->tx_lsu_lsas += num_lsas;
+    len = sizeof(OSPF::Header) + sizeof(OSPF::LSU);
+    num_lsas = 0;
 }
 
 void process_lsu(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
@@ -408,88 +513,218 @@ void process_lsu(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
     assert(nbr != nullptr);
     ospf_lsu->network_to_host();
 
+    // 需要直接确认的LSA，在处理完整个LSU后单播给邻居
+    // 每个报文的临时列表，在线程内复用容量
+    static thread_local std::vector<LSA::Header> direct_acks;
+    direct_acks.clear();
+    // 收到的实例比数据库中的旧，回复数据库中的实例
+    LSUBuilder newer(intf, src_ip);
+    auto& lsdb = intf->area->lsdb;
+    // 本报文是否收齐了已发出的LSR
+    bool batch_done = false;
+
     // 根据LSU更新数据库，并将其从link_state_request_list中删除
-    std::list<LSA::Header *> ls_summary_list;
     size_t offset = sizeof(OSPF::Header) + sizeof(OSPF::LSU);
     for (auto i = 0; i < ospf_lsu->num_lsas; ++i) {
         auto lsahdr = reinterpret_cast<LSA::Header *>(ospf_packet + offset);
+        // 长度错误时无法找到下一条LSA，丢弃其余部分；校验和错误时只丢弃这一条（RFC 2328 13(1)）
+        if (!verify_lsa(ospf_packet + offset, ospf_hdr->length - offset)) {
+            intf->rx_bad_lsas++;
+            auto length = offset + sizeof(LSA::Header) <= ospf_hdr->length ? ntohs(lsahdr->length) : 0;
+            if (length < sizeof(LSA::Header) || offset + length > ospf_hdr->length) {
+                break;
+            }
+            offset += length;
+            continue;
+        }
+        auto recv_hdr = *lsahdr;
+        recv_hdr.network_to_host();
         // 尝试添加到lsdb，如果已存在则根据lsa新旧尝试更新
         LSA::Base *lsa = nullptr;
-        this_lsdb.lock();
-        if (lsahdr->type == LSA::Type::ROUTER) {
-            lsa = new RouterLSA(ospf_packet + offset);
-            this_lsdb.add(lsa);
+        bool installed = false;
+        lsdb.lock();
+        auto db_lsa = lsdb.get(recv_hdr.type, recv_hdr.link_state_id, recv_hdr.advertising_router);
+        // 数据库中没有的MaxAge实例，且没有邻居在交换数据库时，只确认而不安装（RFC 2328 13(4)）
+        if (recv_hdr.age >= LSA::MAX_AGE && db_lsa == nullptr && !lsdb.exchanging()) {
+            lsdb.unlock();
+            offset += recv_hdr.length;
+            direct_acks.push_back(recv_hdr);
+            continue;
+        }
+        // 数据库中的实例不比收到的旧（最常见的是重复的LSA），不必构造新的对象
+        if (db_lsa != nullptr && !LSA::older(db_lsa->header, db_lsa->current_age(), recv_hdr, recv_hdr.age)) {
+            lsa = db_lsa;
+        } else if (lsahdr->type == LSA::Type::ROUTER) {
+            lsa = lsdb.add(new RouterLSA(ospf_packet + offset), &installed);
         } else if (lsahdr->type == LSA::Type::NETWORK) {
-            lsa = new NetworkLSA(ospf_packet + offset);
-            this_lsdb.add(lsa);
-        } else if (lsahdr->type == LSA::Type::SUMMARY) {
-            lsa = new SummaryLSA(ospf_packet + offset);
-            this_lsdb.add(lsa);
+            lsa = lsdb.add(new NetworkLSA(ospf_packet + offset), &installed);
+        } else if (lsahdr->type == LSA::Type::SUMMARY || lsahdr->type == LSA::Type::ASBR_SUMMARY) {
+            lsa = lsdb.add(new SummaryLSA(ospf_packet + offset), &installed);
         } else {
             assert(false && "Not implemented yet");
         }
-        this_lsdb.unlock();
-        offset += lsa->size();
-        // 将收到的lsa加入ls_summary_list以回复LSAck
-        ls_summary_list.push_back(&lsa->header);
+        // 数据库中的实例与收到的相同，即重复的LSA
+        auto duplicate = !installed && lsa->header.sequence_number == recv_hdr.sequence_number &&
+                         lsa->header.checksum == recv_hdr.checksum &&
+                         lsa->is_maxage() == (recv_hdr.age >= LSA::MAX_AGE);
+        if (!installed && !duplicate) {
+            newer.add(lsa);
+        }
+        lsdb.unlock();
+        // add可能丢弃较旧的实例，因此按报文中的长度前进
+        offset += recv_hdr.length;
+
+        // RFC 2328 13.5：新安装的LSA延迟确认；
+        // 重复的LSA若是重传列表中的实例则视为隐含确认，否则直接确认
+        if (installed) {
+            intf->queue_ack(recv_hdr);
+        } else if (duplicate && !nbr->ack_rxmt(recv_hdr)) {
+            direct_acks.push_back(recv_hdr);
+        }
+
         // 将收到的lsa从link_state_request_list中删除
-        nbr->link_state_request_list_mtx.lock();
-        // 理想状态是每次删掉第一个
-        auto it = std::find_if(
-            nbr->link_state_request_list.begin(), nbr->link_state_request_list.end(), [lsa](OSPF::LSR::Request& req) {
-                return req.ls_type == (uint32_t)lsa->header.type && req.link_state_id == lsa->header.link_state_id &&
-                       req.advertising_router == lsa->header.advertising_router;
-            });
-        if (it != nbr->link_state_request_list.end()) {
-            nbr->link_state_request_list.erase(it);
+        if (nbr->remove_request(recv_hdr.key())) {
+            batch_done = true;
         }
-        nbr->link_state_request_list_mtx.unlock();
     }
 
-    // loading_done事件在发送LSR时触发
-    // this_routing_table.update_route();
+    // 已发出的请求全部收到，立即请求下一批，列表为空时触发loading_done
+    if (batch_done) {
+        send_lsr(nbr);
+    }
 
-    // 准备发送LSAck
-    // 按照标准，LSAck需要每隔一段时间，以接口为主体发送现有所有的确认，这里简化了
-    auto len = produce_lsack(ospf_packet + sizeof(OSPF::Header), ls_summary_list);
-    if (intf->type == Interface::Type::BROADCAST) {
-        if (intf->state == Interface::State::DR || intf->state == Interface::State::BACKUP) {
-            send_packet(intf, ospf_packet, len, OSPF::Type::LSACK, ntohl(inet_addr(ALL_SPF_ROUTERS)));
-        } else {
-            send_packet(intf, ospf_packet, len, OSPF::Type::LSACK, ntohl(inet_addr(ALL_DR_ROUTERS)));
-        }
-    } else {
-        send_packet(intf, ospf_packet, len, OSPF::Type::LSACK, src_ip);
+    newer.flush();
+    if (!direct_acks.empty()) {
+        send_lsack(intf, direct_acks, src_ip);
     }
 }
 
-size_t produce_lsack(char *body, const std::list<LSA::Header *>& ls_summary_list) {
+size_t produce_lsack(char *body, const LSA::Header *lsahdrs, size_t num) {
     auto lsack = reinterpret_cast<OSPF::LSAck *>(body);
-    size_t offset = 0;
-    for (auto& lsahdr : ls_summary_list) {
-        memcpy(body + offset, lsahdr, sizeof(LSA::Header));
-        reinterpret_cast<LSA::Header *>(body + offset)->host_to_network();
-        offset += sizeof(LSA::Header);
+    for (size_t i = 0; i < num; ++i) {
+        lsack->lsahdrs[i] = lsahdrs[i];
+        lsack->lsahdrs[i].host_to_network();
+    }
+    return sizeof(LSA::Header) * num;
+}
+
+void send_lsack(Interface *intf, const std::vector<LSA::Header>& lsahdrs, in_addr_t dst) {
+    // 按MTU分成多个报文
+    auto max_num = (intf->mtu - sizeof(iphdr) - sizeof(OSPF::Header)) / sizeof(LSA::Header);
+    PoolBytes data(sizeof(OSPF::Header) + sizeof(LSA::Header) * std::min(max_num, lsahdrs.size()));
+    for (size_t i = 0; i < lsahdrs.size(); i += max_num) {
+        auto num = std::min(max_num, lsahdrs.size() - i);
+        auto len = produce_lsack(data.data() + sizeof(OSPF::Header), lsahdrs.data() + i, num);
+        send_packet(intf, data.data(), len, OSPF::Type::LSACK, dst);
+        intf->tx_lsack_packets++;
     }
-    return offset;
 }
 
 void process_lsack(Interface *intf, char *ospf_packet, in_addr_t src_ip) {
     auto ospf_hdr = reinterpret_cast<OSPF::Header *>(ospf_packet);
-    auto ospf_lsack = reinterpret_cast<OSPF::LSAck *>(ospf_packet + sizeof(OSPF::Header));
     auto nbr = intf->get_neighbor_by_ip(src_ip);
-    assert(nbr != nullptr);
+    // 邻居尚未进入Exchange状态，丢弃
+    if (nbr == nullptr || nbr->state < Neighbor::State::EXCHANGE) {
+        return;
+    }
+
+    // 逐条从重传列表中删除被确认的实例
+    size_t offset = sizeof(OSPF::Header);
+    while (offset + sizeof(LSA::Header) <= ospf_hdr->length) {
+        auto lsahdr = *reinterpret_cast<LSA::Header *>(ospf_packet + offset);
+        lsahdr.network_to_host();
+        nbr->ack_rxmt(lsahdr);
+        offset += sizeof(LSA::Header);
+    }
+}
+
+uint32_t flood_delay_ms = 10;
+
+// 在哪些接口上洪泛
+static bool floods_on(Interface *intf) {
+    return intf->state == Interface::State::DROTHER || intf->state == Interface::State::BACKUP ||
+           intf->state == Interface::State::POINT2POINT;
+}
+
+static void send_flood(Area *area, const std::vector<PoolBytes>& lsas) {
+    for (auto& intf : area->interfaces) {
+        if (floods_on(intf)) {
+            LSUBuilder builder(intf, ntohl(inet_addr(ALL_SPF_ROUTERS)));
+            for (auto& lsa : lsas) {
+                builder.add(lsa.data(), lsa.size());
+            }
+            builder.flush();
+        }
+    }
+}
+
+void flush_flood(Area *area) {
+    std::lock_guard<std::mutex> lock(area->flood_mtx);
+    auto& flood_queue = area->flood_queue;
+    this_timers.cancel_and_reset(flood_queue.timer);
+    if (flood_queue.lsas.empty()) {
+        return;
+    }
+    send_flood(area, flood_queue.lsas);
+    flood_queue.lsas.clear();
+    flood_queue.index.clear();
+    flood_queue.bytes = 0;
 }
 
-void flood_lsa(LSA::Base *lsa) {
-    char buf[ETH_DATA_LEN];
-    auto len = produce_lsu(buf + sizeof(OSPF::Header), {lsa});
-    for (auto& intf : this_interfaces) {
-        if (intf->state == Interface::State::DROTHER || intf->state == Interface::State::BACKUP ||
-            intf->state == Interface::State::POINT2POINT) {
-            send_packet(intf, buf, len, OSPF::Type::LSU, ntohl(inet_addr(ALL_SPF_ROUTERS)));
+// LSA在调用时写出，之后可以被替换或删除
+// 洪泛范围为LSA所在的区域
+void flood_lsa(Area *area, LSA::Base *lsa) {
+    PoolBytes data(lsa->size());
+    produce_lsa(data.data(), lsa);
+    // 等待邻接的确认，超时后单播重传；在排队时即加入，清除的LSA在确认前不会被删除
+    for (auto& intf : area->interfaces) {
+        if (floods_on(intf)) {
+            for (auto& nbr : intf->neighbors) {
+                if (nbr->state >= Neighbor::State::EXCHANGE) {
+                    nbr->add_rxmt(data.data(), data.size());
+                }
+            }
         }
     }
+    if (flood_delay_ms == 0) {
+        send_flood(area, {std::move(data)});
+        return;
+    }
+
+    // 最小的接口MTU所能装下的LSA长度
+    size_t limit = SIZE_MAX;
+    for (auto& intf : area->interfaces) {
+        limit = std::min(limit, intf->mtu - sizeof(iphdr) - sizeof(OSPF::Header) - sizeof(OSPF::LSU));
+    }
+
+    std::unique_lock<std::mutex> lock(area->flood_mtx);
+    auto& flood_queue = area->flood_queue;
+    auto key = std::make_tuple(lsa->header.type, in_addr_t(lsa->header.link_state_id),
+                               in_addr_t(lsa->header.advertising_router));
+    while (true) {
+        auto it = flood_queue.index.find(key);
+        if (it != flood_queue.index.end()) {
+            auto& queued = flood_queue.lsas[it->second];
+            flood_queue.bytes -= queued.size();
+            flood_queue.bytes += data.size();
+            queued = std::move(data);
+            return;
+        }
+        // 再加入就装不进一个报文，先发出已有的
+        if (flood_queue.lsas.empty() || flood_queue.bytes + data.size() <= limit) {
+            break;
+        }
+        // 放锁期间其它线程可能已将同一LSA或其它LSA加入队列，重新查找
+        lock.unlock();
+        flush_flood(area);
+        lock.lock();
+    }
+    flood_queue.index.emplace(key, flood_queue.lsas.size());
+    flood_queue.bytes += data.size();
+    flood_queue.lsas.push_back(std::move(data));
+    if (flood_queue.timer == 0) {
+        flood_queue.timer = this_timers.add(flood_delay_ms, [area] { flush_flood(area); });
+    }
 }
 
 // abort: manually forward ICMP packet
@@ -1,14 +1,24 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <iterator>
+#include <list>
 #include <netinet/in.h>
 #include <vector>
 
+#include "pool.hpp"
 #include "utils.hpp"
 
+class Area;
+class Interface;
+class Neighbor;
+
 namespace LSA {
 
 /* LSA types. */
@@ -20,6 +30,36 @@ enum struct Type : uint8_t {
     AS_EXTERNAL
 };
 
+/* 体系结构常量（RFC 2328 附录B），单位秒 */
+constexpr uint16_t MAX_AGE = 3600;
+constexpr uint16_t MAX_AGE_DIFF = 900;
+constexpr uint16_t LS_REFRESH_TIME = 1800;
+constexpr uint16_t INF_TRANS_DELAY = 1;
+
+/* 单调时钟的秒数，LSA的年龄由它惰性算出 */
+static inline uint32_t now_seconds() noexcept {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/* LSA的标识(类型, ls_id, adv_rtr)，用作哈希表的键 */
+struct Key {
+    Type type;
+    in_addr_t link_state_id;
+    in_addr_t advertising_router;
+
+    bool operator==(const Key& rhs) const noexcept {
+        return type == rhs.type && link_state_id == rhs.link_state_id && advertising_router == rhs.advertising_router;
+    }
+};
+
+struct KeyHash {
+    size_t operator()(const Key& key) const noexcept {
+        auto value = (static_cast<uint64_t>(key.link_state_id) << 32) | key.advertising_router;
+        return std::hash<uint64_t>()(value ^ (static_cast<uint64_t>(key.type) << 56));
+    }
+};
+
 /* LSA header structure. */
 struct Header {
     uint16_t age;
@@ -53,8 +93,32 @@ struct Header {
     bool operator==(const Header& rhs) const {
         return type == rhs.type && link_state_id == rhs.link_state_id && advertising_router == rhs.advertising_router;
     }
+
+    Key key() const noexcept {
+        return {type, link_state_id, advertising_router};
+    }
 } __attribute__((packed));
 
+/* 同一LSA的两个实例，a比b旧时返回true（RFC 2328 13.1），age为各自的当前年龄 */
+static inline bool older(const Header& a, uint16_t age, const Header& b, uint16_t b_age) noexcept {
+    if (a.sequence_number != b.sequence_number) {
+        return a.sequence_number < b.sequence_number;
+    }
+    if (a.checksum != b.checksum) {
+        return a.checksum < b.checksum;
+    }
+    // MaxAge的实例较新；年龄相差超过MaxAgeDiff时，年龄小的较新
+    age = std::min(age, MAX_AGE);
+    b_age = std::min(b_age, MAX_AGE);
+    if ((age == MAX_AGE) != (b_age == MAX_AGE)) {
+        return b_age == MAX_AGE;
+    }
+    if (age > b_age + MAX_AGE_DIFF) {
+        return true;
+    }
+    return false;
+}
+
 /* Router-LSA Link types. */
 enum class LinkType : uint8_t {
     POINT2POINT = 1,
@@ -63,31 +127,168 @@ enum class LinkType : uint8_t {
     VIRTUAL
 };
 
+/* 原文中定长记录序列的只读视图，解引用时按需解码为主机字节序 */
+template <typename T, size_t STRIDE, T (*DECODE)(const char *)>
+class View {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T *;
+        using reference = T;
+
+        explicit iterator(const char *ptr) : ptr(ptr) {
+        }
+        T operator*() const {
+            return DECODE(ptr);
+        }
+        iterator& operator++() {
+            ptr += STRIDE;
+            return *this;
+        }
+        bool operator==(const iterator& rhs) const {
+            return ptr == rhs.ptr;
+        }
+        bool operator!=(const iterator& rhs) const {
+            return ptr != rhs.ptr;
+        }
+
+    private:
+        const char *ptr;
+    };
+
+    View(const char *first, size_t num) : first(first), num(num) {
+    }
+    iterator begin() const {
+        return iterator(first);
+    }
+    iterator end() const {
+        return iterator(first + num * STRIDE);
+    }
+    size_t size() const {
+        return num;
+    }
+    T operator[](size_t i) const {
+        return DECODE(first + i * STRIDE);
+    }
+
+private:
+    const char *first;
+    size_t num;
+};
+
+/* 从网络字节序的原文中解码，原文不保证对齐 */
+static inline uint16_t get16(const char *ptr) noexcept {
+    uint16_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return ntohs(value);
+}
+static inline uint32_t get24(const char *ptr) noexcept {
+    auto bytes = reinterpret_cast<const uint8_t *>(ptr);
+    return bytes[0] << 16 | bytes[1] << 8 | bytes[2];
+}
+static inline uint32_t get32(const char *ptr) noexcept {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return ntohl(value);
+}
+
 /* Base LSA structure. */
+// LSA以网络字节序的原文保存，洪泛和回复LSR时直接复制原文
+// header是原文头部的主机字节序副本，各类型的其余字段由访问函数按需解码
 struct Base {
     Header header;
-    virtual size_t size() const = 0;
+    // header.age对应的时刻，年龄不逐秒递增，而是在需要时由两者算出
+    uint32_t arrival = now_seconds();
+    // 完整的LSA原文（含头部），原文中的年龄只在写出时更新
+    PoolBytes data;
+
+    Base() = default;
+    /* 复制收到的LSA原文 */
+    Base(const char *net_ptr) {
+        header = *reinterpret_cast<const Header *>(net_ptr);
+        header.network_to_host();
+        data.assign(net_ptr, net_ptr + header.length);
+    }
+    virtual ~Base() = default;
+
+    /* 复制一个同类型的实例 */
+    virtual Base *clone() const = 0;
+
+    /* 对象本身也从内存池分配，虚析构保证释放时传入实际类型的大小 */
+    static void *operator new(size_t size) {
+        return this_pool.alloc(size);
+    }
+    static void operator delete(void *ptr, size_t size) noexcept {
+        this_pool.free(ptr, size);
+    }
+
+    size_t size() const noexcept {
+        return data.size();
+    }
 
-    virtual void to_packet(char *packet) const {
-        /* Copy the header. */
-        memcpy(packet, &header, sizeof(Header));
-        reinterpret_cast<Header *>(packet)->host_to_network();
+    /* 当前年龄，不超过MAX_AGE */
+    uint16_t current_age() const noexcept {
+        auto age = header.age + (now_seconds() - arrival);
+        return age < MAX_AGE ? age : MAX_AGE;
+    }
+    /* 重设年龄（生成、收到或清除时） */
+    void set_age(uint16_t age) noexcept {
+        header.age = age;
+        arrival = now_seconds();
+    }
+    /* 已被清除（年龄置为MAX_AGE），不再参与路由计算 */
+    bool is_maxage() const noexcept {
+        return header.age >= MAX_AGE;
     }
 
-    virtual void make_checksum() = 0;
+    /* 写出原文，年龄为当前年龄 */
+    void to_packet(char *packet) const {
+        memcpy(packet, data.data(), data.size());
+        reinterpret_cast<Header *>(packet)->age = htons(current_age());
+    }
+
+    /* 生成LSA后调用：将header写入原文并计算校验和 */
+    void make_checksum() {
+        header.length = data.size();
+        auto hdr = reinterpret_cast<Header *>(data.data());
+        *hdr = header;
+        hdr->host_to_network();
+        header.checksum = fletcher16(data.data() + 2, header.length - 2, 14);
+        hdr->checksum = htons(header.checksum);
+    }
 
     bool operator<(const Base& rhs) const {
         assert(header.link_state_id == rhs.header.link_state_id);
         assert(header.advertising_router == rhs.header.advertising_router);
-        if (header.sequence_number != rhs.header.sequence_number) {
-            return header.sequence_number < rhs.header.sequence_number;
-        }
-        return header.checksum < rhs.header.checksum;
+        return older(header, current_age(), rhs.header, rhs.current_age());
     }
 
     bool operator>(const Base& rhs) const {
         return rhs < *this;
     }
+
+protected:
+    /* 原文中头部之后的部分 */
+    const char *body() const noexcept {
+        return data.data() + sizeof(Header);
+    }
+    /* 原文中头部之后能容纳的定长记录数，不信任报文中的计数 */
+    size_t body_records(size_t offset, size_t stride) const noexcept {
+        auto len = data.size() - sizeof(Header);
+        return len > offset ? (len - offset) / stride : 0;
+    }
+    /* 生成LSA时追加字段 */
+    void put16(uint16_t value) {
+        value = htons(value);
+        data.insert(data.end(), reinterpret_cast<char *>(&value), reinterpret_cast<char *>(&value) + sizeof(value));
+    }
+    void put32(uint32_t value) {
+        value = htonl(value);
+        data.insert(data.end(), reinterpret_cast<char *>(&value), reinterpret_cast<char *>(&value) + sizeof(value));
+    }
 };
 
 /* Router-LSA structure. */
@@ -104,199 +305,102 @@ struct Router : public Base {
         Link(in_addr_t link_id, in_addr_t link_data, LinkType type, uint16_t metric)
             : link_id(link_id), link_data(link_data), type(type), tos(0), metric(metric) {
         }
-        Link(char *net_ptr) {
-            link_id = ntohl(*reinterpret_cast<in_addr_t *>(net_ptr));
-            net_ptr += sizeof(link_id);
-            link_data = ntohl(*reinterpret_cast<in_addr_t *>(net_ptr));
-            net_ptr += sizeof(link_data);
-            type = *reinterpret_cast<LinkType *>(net_ptr);
-            net_ptr += sizeof(type);
-            tos = 0;
-            net_ptr += sizeof(tos);
-            metric = ntohs(*reinterpret_cast<uint16_t *>(net_ptr));
-        }
-    } __attribute__((packed));
 
-    uint16_t flags;
-    uint16_t num_links;
-    std::vector<Link> links;
-
-    Router() = default;
-    Router(char *net_ptr) {
-        /* Parse the header. */
-        header = *reinterpret_cast<Header *>(net_ptr);
-        header.network_to_host();
-        /* Parse the router-LSA Data. */
-        net_ptr += sizeof(Header);
-        flags = ntohs(*reinterpret_cast<uint16_t *>(net_ptr));
-        net_ptr += sizeof(flags);
-        num_links = ntohs(*reinterpret_cast<uint16_t *>(net_ptr));
-        net_ptr += sizeof(num_links);
-        for (auto i = 0; i < num_links; ++i) {
-            // auto link = Link(net_ptr);
-            links.emplace_back(net_ptr);
-            net_ptr += sizeof(Link);
+        static Link decode(const char *net_ptr) noexcept {
+            Link link;
+            link.link_id = get32(net_ptr);
+            link.link_data = get32(net_ptr + 4);
+            link.type = static_cast<LinkType>(net_ptr[8]);
+            link.tos = 0;
+            link.metric = get16(net_ptr + 10);
+            return link;
         }
-    }
+    };
+    /* 原文中一条链路（不含TOS度量）的长度 */
+    static constexpr size_t LINK_SIZE = 12;
+    using Links = View<Link, LINK_SIZE, Link::decode>;
 
-    size_t size() const override {
-        return sizeof(Header) + sizeof(flags) + sizeof(num_links) + links.size() * sizeof(Link);
-    }
-
-    void to_packet(char *packet) const override {
-        /* Initialize the packet. */
-        // auto packet = new char[size()];
-
-        Base::to_packet(packet);
-
-        /* Copy the router-LSA Data. */
-        auto net_ptr = packet + sizeof(Header);
-        *reinterpret_cast<uint16_t *>(net_ptr) = htons(flags);
-        net_ptr += sizeof(flags);
-        *reinterpret_cast<uint16_t *>(net_ptr) = htons(num_links);
-        net_ptr += sizeof(num_links);
-        for (const auto& link : links) {
-            *reinterpret_cast<in_addr_t *>(net_ptr) = htonl(link.link_id);
-            net_ptr += sizeof(in_addr_t);
-            *reinterpret_cast<in_addr_t *>(net_ptr) = htonl(link.link_data);
-            net_ptr += sizeof(in_addr_t);
-            *reinterpret_cast<LinkType *>(net_ptr) = link.type;
-            net_ptr += sizeof(LinkType);
-            *reinterpret_cast<uint8_t *>(net_ptr) = link.tos;
-            net_ptr += sizeof(uint8_t);
-            *reinterpret_cast<uint16_t *>(net_ptr) = htons(link.metric);
-            net_ptr += sizeof(uint16_t);
-        }
-        // reinterpret_cast<Header *>(packet)->checksum =
-        //     htons(fletcher16(packet + 2, header.length - 2, offsetof(Header, checksum)));
-        // return packet;
+    /* 生成空的Router-LSA，flags和链路数为0 */
+    Router() {
+        data.resize(sizeof(Header));
+        put16(0);
+        put16(0);
+    }
+    Router(const char *net_ptr) : Base(net_ptr) {
+    }
+    Base *clone() const override {
+        return new Router(*this);
     }
 
-    void make_checksum() override {
-        char *packet = new char[size()]; // alloc to avoid vla
-        to_packet(packet);
-        header.checksum = fletcher16(packet + 2, header.length - 2, 14);
-        delete[] packet;
+    uint16_t flags() const noexcept {
+        return get16(body());
+    }
+    uint16_t num_links() const noexcept {
+        return get16(body() + 2);
+    }
+    Links links() const noexcept {
+        return Links(body() + 4, std::min<size_t>(num_links(), body_records(4, LINK_SIZE)));
     }
 
-    bool operator==(const Router& rhs) const {
-        return header.link_state_id == rhs.header.link_state_id &&
-               header.advertising_router == rhs.header.advertising_router &&
-               header.sequence_number == rhs.header.sequence_number;
+    /* 生成LSA时追加链路 */
+    void add_link(const Link& link) {
+        put32(link.link_id);
+        put32(link.link_data);
+        data.push_back(static_cast<char>(link.type));
+        data.push_back(0);
+        put16(link.metric);
+        auto num = htons(num_links() + 1);
+        memcpy(data.data() + sizeof(Header) + 2, &num, sizeof(num));
     }
 };
 
 /* Network-LSA structure. */
 struct Network : public Base {
-    in_addr_t network_mask;
-    std::vector<in_addr_t> attached_routers;
-
-    Network() = default;
-    Network(char *net_ptr) {
-        /* Parse the header. */
-        header = *reinterpret_cast<Header *>(net_ptr);
-        header.network_to_host();
-        auto attr_end = net_ptr + header.length;
-        /* Parse the network-LSA Data. */
-        net_ptr += sizeof(Header);
-        network_mask = ntohl(*reinterpret_cast<in_addr_t *>(net_ptr));
-        net_ptr += sizeof(network_mask);
-        while (net_ptr < attr_end) {
-            attached_routers.emplace_back(ntohl(*reinterpret_cast<in_addr_t *>(net_ptr)));
-            net_ptr += sizeof(in_addr_t);
-        }
+    static in_addr_t decode_router(const char *net_ptr) noexcept {
+        return get32(net_ptr);
     }
+    using Routers = View<in_addr_t, sizeof(in_addr_t), decode_router>;
 
-    size_t size() const override {
-        return sizeof(Header) + sizeof(network_mask) + attached_routers.size() * sizeof(in_addr_t);
+    /* 生成Network-LSA，之后追加连接的路由器 */
+    Network(in_addr_t network_mask) {
+        data.resize(sizeof(Header));
+        put32(network_mask);
     }
-
-    void to_packet(char *packet) const override {
-        /* Initialize the packet. */
-        // auto packet = new char[size()];
-
-        Base::to_packet(packet);
-
-        /* Copy the network-LSA Data. */
-        auto net_ptr = packet + sizeof(Header);
-        *reinterpret_cast<in_addr_t *>(net_ptr) = htonl(network_mask);
-        net_ptr += sizeof(in_addr_t);
-        for (const auto& router : attached_routers) {
-            *reinterpret_cast<in_addr_t *>(net_ptr) = htonl(router);
-            net_ptr += sizeof(in_addr_t);
-        }
-        // reinterpret_cast<Header *>(packet)->checksum =
-        //     fletcher16(packet + 2, header.length - 2, offsetof(Header, checksum));
-        // return packet;
+    Network(const char *net_ptr) : Base(net_ptr) {
+    }
+    Base *clone() const override {
+        return new Network(*this);
     }
 
-    void make_checksum() override {
-        char *packet = new char[size()]; // alloc to avoid vla
-        to_packet(packet);
-        header.checksum = fletcher16(packet + 2, header.length - 2, 14);
-        delete[] packet;
+    in_addr_t network_mask() const noexcept {
+        return get32(body());
+    }
+    Routers attached_routers() const noexcept {
+        return Routers(body() + sizeof(in_addr_t), body_records(sizeof(in_addr_t), sizeof(in_addr_t)));
     }
 
-    bool operator==(const Network& rhs) const {
-        return header.link_state_id == rhs.header.link_state_id &&
-               header.advertising_router == rhs.header.advertising_router && header.length == rhs.header.length &&
-               network_mask == rhs.network_mask && attached_routers == rhs.attached_routers;
+    void add_attached_router(in_addr_t router_id) {
+        put32(router_id);
     }
 };
 
 /* Summary-LSA structure. */
 struct Summary : public Base {
-    in_addr_t network_mask;
-    // union {
-    //     uint8_t tos;
-    //     uint32_t metric;
-    // };
-    uint8_t tos;
-    uint32_t metric; // 实际上是24位的一个字段，需要特殊处理
-
-    Summary(char *net_ptr) {
-        /* Parse the header. */
-        header = *reinterpret_cast<Header *>(net_ptr);
-        header.network_to_host();
-        /* Parse the summary-LSA Data. */
-        net_ptr += sizeof(Header);
-        network_mask = ntohl(*reinterpret_cast<in_addr_t *>(net_ptr));
-        net_ptr += sizeof(network_mask);
-        tos = *reinterpret_cast<uint8_t *>(net_ptr);
-        net_ptr += sizeof(tos);
-        uint8_t metric_bytes[3];
-        memcpy(metric_bytes, net_ptr, sizeof(metric_bytes));
-        metric = metric_bytes[0] << 16 | metric_bytes[1] << 8 | metric_bytes[2]; // ATTN: check
-    }
-
-    size_t size() const override {
-        return sizeof(Header) + sizeof(network_mask) + sizeof(metric);
-    }
-
-    void to_packet(char *packet) const override {
-        /* Initialize the packet. */
-        // auto packet = new char[size()];
-
-        Base::to_packet(packet);
-
-        /* Copy the summary-LSA Data. */
-        auto net_ptr = packet + sizeof(Header);
-        *reinterpret_cast<in_addr_t *>(net_ptr) = htonl(network_mask);
-        net_ptr += sizeof(in_addr_t);
-        *reinterpret_cast<uint8_t *>(net_ptr) = tos;
-        net_ptr += sizeof(uint8_t);
-        uint8_t metric_bytes[3] = {(uint8_t)(metric >> 16), (uint8_t)(metric >> 8), (uint8_t)(metric)};
-        memcpy(net_ptr, metric_bytes, sizeof(metric_bytes)); // ATTN: check
-        // reinterpret_cast<Header *>(packet)->checksum =
-        //     fletcher16(packet + 2, header.length - 2, offsetof(Header, checksum));
-        // return packet;
-    }
-
-    void make_checksum() override {
-        char *packet = new char[size()]; // alloc to avoid vla
-        to_packet(packet);
-        header.checksum = fletcher16(packet + 2, header.length - 2, 14);
-        delete[] packet;
+    Summary(const char *net_ptr) : Base(net_ptr) {
+    }
+    Base *clone() const override {
+        return new Summary(*this);
+    }
+
+    in_addr_t network_mask() const noexcept {
+        return get32(body());
+    }
+    uint8_t tos() const noexcept {
+        return body()[4];
+    }
+    // 实际上是24位的一个字段
+    uint32_t metric() const noexcept {
+        return get24(body() + 5);
     }
 };
 
@@ -305,70 +409,30 @@ struct Summary : public Base {
 
 /* AS-external-LSA structure. */
 struct ASExternal : public Base {
-    in_addr_t network_mask;
     struct ExternRoute {
         uint8_t tos;
 #define AS_EXTERNAL_FLAG 0x01
         uint32_t metric; // 同样是24位的一个字段
         in_addr_t forwarding_address;
         uint32_t external_router_tag;
-    };
-
-    std::vector<ExternRoute> e;
 
-    ASExternal(char *net_ptr) {
-        /* Parse the header. */
-        header = *reinterpret_cast<Header *>(net_ptr);
-        header.network_to_host();
-        /* Parse the AS-external-LSA Data. */
-        net_ptr += sizeof(Header);
-        network_mask = ntohl(*reinterpret_cast<in_addr_t *>(net_ptr));
-        net_ptr += sizeof(network_mask);
-        while (net_ptr < net_ptr + header.length) {
-            ExternRoute er;
-            er.tos = *reinterpret_cast<uint8_t *>(net_ptr);
-            net_ptr += sizeof(er.tos);
-            uint8_t metric_bytes[3];
-            memcpy(metric_bytes, net_ptr, sizeof(metric_bytes));
-            er.metric = metric_bytes[0] << 16 | metric_bytes[1] << 8 | metric_bytes[2]; // ATTN: check
-            net_ptr += sizeof(metric_bytes);
-            er.forwarding_address = ntohl(*reinterpret_cast<in_addr_t *>(net_ptr));
-            net_ptr += sizeof(er.forwarding_address);
-            er.external_router_tag = ntohl(*reinterpret_cast<uint32_t *>(net_ptr));
-            net_ptr += sizeof(er.external_router_tag);
-            e.push_back(er);
+        static ExternRoute decode(const char *net_ptr) noexcept {
+            return {static_cast<uint8_t>(net_ptr[0]), get24(net_ptr + 1), get32(net_ptr + 4), get32(net_ptr + 8)};
         }
-    }
+    };
+    using ExternRoutes = View<ExternRoute, 12, ExternRoute::decode>;
 
-    size_t size() const override {
-        return sizeof(Header) + sizeof(network_mask) +
-               e.size() * (sizeof(uint32_t) + sizeof(in_addr_t) + sizeof(uint32_t));
+    ASExternal(const char *net_ptr) : Base(net_ptr) {
+    }
+    Base *clone() const override {
+        return new ASExternal(*this);
     }
 
-    void to_packet(char *packet) const override {
-        /* Initialize the packet. */
-        // auto packet = new char[size()];
-
-        Base::to_packet(packet);
-
-        /* Copy the AS-external-LSA Data. */
-        auto net_ptr = packet + sizeof(Header);
-        *reinterpret_cast<in_addr_t *>(net_ptr) = htonl(network_mask);
-        net_ptr += sizeof(in_addr_t);
-        for (const auto& er : e) {
-            *reinterpret_cast<uint8_t *>(net_ptr) = er.tos;
-            net_ptr += sizeof(er.tos);
-            uint8_t metric_bytes[3] = {(uint8_t)(er.metric >> 16), (uint8_t)(er.metric >> 8), (uint8_t)(er.metric)};
-            memcpy(net_ptr, metric_bytes, sizeof(metric_bytes)); // ATTN: check
-            net_ptr += sizeof(metric_bytes);
-            *reinterpret_cast<in_addr_t *>(net_ptr) = htonl(er.forwarding_address);
-            net_ptr += sizeof(er.forwarding_address);
-            *reinterpret_cast<uint32_t *>(net_ptr) = htonl(er.external_router_tag);
-            net_ptr += sizeof(er.external_router_tag);
-        }
-        // reinterpret_cast<Header *>(packet)->checksum =
-        //     fletcher16(packet + 2, header.length - 2, offsetof(Header, checksum));
-        // return packet;
+    in_addr_t network_mask() const noexcept {
+        return get32(body());
+    }
+    ExternRoutes e() const noexcept {
+        return ExternRoutes(body() + sizeof(in_addr_t), body_records(sizeof(in_addr_t), 12));
     }
 };
 
@@ -540,6 +604,10 @@ struct LSAck {
 } __attribute__((packed));
 
 void send_packet(Interface *intf, char *packet, size_t len, OSPF::Type type, in_addr_t dst);
+/* 检查收到的OSPF报文（网络字节序）的长度和校验和，len为IP载荷长度 */
+bool verify_packet(const char *packet, size_t len);
+/* 检查LSU中一条LSA（网络字节序）的长度和校验和，len为报文中剩余的长度 */
+bool verify_lsa(const char *lsa, size_t len);
 
 size_t produce_hello(Interface *intf, char *body);
 void process_hello(Interface *intf, char *ospf_packet, in_addr_t src_ip);
@@ -547,16 +615,58 @@ void process_hello(Interface *intf, char *ospf_packet, in_addr_t src_ip);
 size_t produce_dd(char *body, Neighbor *nbr);
 void process_dd(Interface *intf, char *ospf_packet, in_addr_t src_ip);
 
-size_t produce_lsr(char *body, Neighbor *nbr);
+size_t produce_lsr(char *body, const OSPF::LSR::Request *reqs, size_t num);
+/* 从请求列表前部取出至多lsr_max_in_flight个请求发出，超过MTU时分为多个报文 */
+/* 列表为空且处于Loading状态时触发loading_done */
+void send_lsr(Neighbor *nbr);
+/* 同时在途的LSR请求数上限，0表示一个MTU的LSR能容纳的数量 */
+extern uint32_t lsr_max_in_flight;
 void process_lsr(Interface *intf, char *ospf_packet, in_addr_t src_ip);
 
-size_t produce_lsu(char *body, const std::list<LSA::Base *>& lsa_update_list);
+/*
+ * LSU报文构造器：
+ * - 按接口MTU尽可能多地装入LSA，放不下下一条时先发出已装入的部分；
+ * - 单条LSA超过MTU时单独发送，由IP层分片；
+ * - 发送缓冲区在多个报文之间复用。
+ */
+class LSUBuilder {
+public:
+    LSUBuilder(Interface *intf, in_addr_t dst);
+
+    /* 追加一条LSA，年龄按当前年龄加InfTransDelay写入 */
+    void add(const LSA::Base *lsa);
+    /* 追加一条已是网络字节序的LSA */
+    void add(const char *lsa, size_t len);
+    /* 发出尚未发送的LSA */
+    void flush();
+
+private:
+    Interface *intf;
+    in_addr_t dst;
+    // OSPF报文（含OSPF头部）的最大长度
+    size_t limit;
+    PoolBytes buf;
+    size_t len;
+    uint32_t num_lsas = 0;
+
+    char *reserve(size_t lsa_len);
+};
+
+/* 将LSA写为网络字节序，年龄加上InfTransDelay，返回长度 */
+size_t produce_lsa(char *dst, const LSA::Base *lsa);
 void process_lsu(Interface *intf, char *ospf_packet, in_addr_t src_ip);
 
-size_t produce_lsack(char *body, const std::list<LSA::Header *>& ls_summary_list);
+size_t produce_lsack(char *body, const LSA::Header *lsahdrs, size_t num);
+/* 发送确认，lsahdrs为主机字节序，超过MTU时分为多个报文 */
+void send_lsack(Interface *intf, const std::vector<LSA::Header>& lsahdrs, in_addr_t dst);
 void process_lsack(Interface *intf, char *ospf_packet, in_addr_t src_ip);
 
-void flood_lsa(LSA::Base *lsa);
+/* 在区域内洪泛LSA：flood_delay_ms内到达的LSA合并到同一批LSU中发送 */
+void flood_lsa(Area *area, LSA::Base *lsa);
+/* 立即发出区域内所有等待洪泛的LSA */
+void flush_flood(Area *area);
+/* 洪泛合并窗口，单位毫秒，0表示立即发送 */
+extern uint32_t flood_delay_ms;
 
 void forward_icmp(char *packet, size_t len, in_addr_t src_ip, in_addr_t dst_ip);
 
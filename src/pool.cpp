@@ -0,0 +1,62 @@
+#include <new>
+#include <type_traits>
+
+#include "pool.hpp"
+
+SlabPool this_pool;
+static_assert(std::is_trivially_destructible<SlabPool>::value, "this_pool must outlive other globals");
+
+void *SlabPool::alloc(size_t size) {
+    if (size > (1u << MAX_SHIFT)) {
+        large_allocs++;
+        return ::operator new(size);
+    }
+    auto index = class_of(size);
+    auto block = size_t(1) << (index + MIN_SHIFT);
+    auto& sc = classes[index];
+    std::lock_guard<std::mutex> lock(sc.mtx);
+    sc.allocs++;
+    if (sc.free_list != nullptr) {
+        auto ptr = sc.free_list;
+        sc.free_list = ptr->next;
+        return ptr;
+    }
+    if (sc.slab_pos == sc.slab_end) {
+        sc.slab_pos = static_cast<char *>(::operator new(SLAB_SIZE));
+        sc.slab_end = sc.slab_pos + SLAB_SIZE;
+        sc.slabs++;
+    }
+    auto ptr = sc.slab_pos;
+    sc.slab_pos += block;
+    return ptr;
+}
+
+void SlabPool::free(void *ptr, size_t size) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (size > (1u << MAX_SHIFT)) {
+        ::operator delete(ptr);
+        return;
+    }
+    auto& sc = classes[class_of(size)];
+    std::lock_guard<std::mutex> lock(sc.mtx);
+    sc.frees++;
+    auto block = static_cast<FreeBlock *>(ptr);
+    block->next = sc.free_list;
+    sc.free_list = block;
+}
+
+void SlabPool::print_stats(std::ostream& os) noexcept {
+    os << "Pool Statistics:" << std::endl;
+    for (size_t i = 0; i < NUM_CLASSES; ++i) {
+        auto& sc = classes[i];
+        std::lock_guard<std::mutex> lock(sc.mtx);
+        if (sc.allocs == 0) {
+            continue;
+        }
+        os << "	" << (1u << (i + MIN_SHIFT)) << "B: allocs " << sc.allocs << ", in use " << sc.allocs - sc.frees
+           << ", slabs " << sc.slabs << std::endl;
+    }
+    os << "	large allocs: " << large_allocs << std::endl;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+// 按大小分级的slab内存池
+// 16字节到4KB按2的幂分为9级，每级从64KB的slab中切出等长的块，释放的块挂在该级的空闲链表上复用，slab不归还
+// 更大的请求直接使用operator new
+// LSA对象及其原文、LSDB和邻居的各个列表结点都从这里分配，收发LSU的热路径在预热后不再访问通用堆
+class SlabPool {
+public:
+    static constexpr size_t MIN_SHIFT = 4;
+    static constexpr size_t MAX_SHIFT = 12;
+    static constexpr size_t NUM_CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+    void *alloc(size_t size);
+    void free(void *ptr, size_t size) noexcept;
+
+    void print_stats(std::ostream& os) noexcept;
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+    // 每级单独加锁，LSA在recv线程和定时器线程中都会分配
+    struct SizeClass {
+        std::mutex mtx;
+        FreeBlock *free_list = nullptr;
+        char *slab_pos = nullptr;
+        char *slab_end = nullptr;
+        uint64_t allocs = 0;
+        uint64_t frees = 0;
+        uint64_t slabs = 0; // 向通用堆申请的slab数
+    };
+    SizeClass classes[NUM_CLASSES];
+    // 超过最大分级、直接使用operator new的次数
+    std::atomic<uint64_t> large_allocs{0};
+
+    static size_t class_of(size_t size) noexcept {
+        if (size <= (1u << MIN_SHIFT)) {
+            return 0;
+        }
+        return (sizeof(unsigned long) * 8 - __builtin_clzl(size - 1)) - MIN_SHIFT;
+    }
+};
+
+// 成员均可平凡析构，进程退出时全局对象析构后仍可安全释放
+extern SlabPool this_pool;
+
+/* 从this_pool分配的标准分配器，用于容器的结点和缓冲区 */
+template <typename T>
+struct PoolAllocator {
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {
+    }
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(this_pool.alloc(n * sizeof(T)));
+    }
+    void deallocate(T *ptr, size_t n) noexcept {
+        this_pool.free(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept {
+        return false;
+    }
+};
+
+/* 从内存池分配的字节缓冲区和容器 */
+using PoolBytes = std::vector<char, PoolAllocator<char>>;
+template <typename T>
+using PoolList = std::list<T, PoolAllocator<T>>;
+template <typename K, typename V, typename Hash = std::hash<K>>
+using PoolMap = std::unordered_map<K, V, Hash, std::equal_to<K>, PoolAllocator<std::pair<const K, V>>>;
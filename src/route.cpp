@@ -1,31 +1,38 @@
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <queue>
+#include <unordered_set>
 
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include "area.hpp"
 #include "interface.hpp"
 #include "lsdb.hpp"
 #include "neighbor.hpp"
 #include "packet.hpp"
 #include "route.hpp"
+#include "timer.hpp"
 #include "utils.hpp"
 
 RoutingTable this_routing_table;
 
-// 查找路由表
+// 查找路由表，最长前缀匹配
 // 返回下一跳地址和接口
 std::pair<in_addr_t, Interface *> RoutingTable::lookup_route(in_addr_t dst) const noexcept {
+    auto trie = std::atomic_load(&fib);
+    return trie->lookup(dst);
+}
+
+void RoutingTable::publish_fib() {
+    auto trie = std::make_shared<PrefixTrie>();
     for (auto& route : routes) {
-        if ((dst & route.mask) == route.dst) {
-            return {route.next_hop, route.intf};
-        }
+        trie->insert(route.dst, route.mask, {route.next_hop, route.intf});
     }
-    return {0, nullptr};
+    std::atomic_store(&fib, std::shared_ptr<const PrefixTrie>(std::move(trie)));
 }
 
 // 打印路由表
@@ -44,6 +51,10 @@ void RoutingTable::print() const noexcept {
                   << std::setw(15) << ip_to_str(route.next_hop)     //
                   << std::setw(15) << route.metric << std::setw(15) //
                   << (route.intf ? route.intf->name : "direct") << std::endl;
+        for (size_t i = 1; i < route.paths.size(); ++i) {
+            std::cout << std::left << std::setw(30) << "" << std::setw(15) << ip_to_str(route.paths[i].addr)
+                      << std::setw(15) << "" << route.paths[i].intf->name << std::endl;
+        }
     }
 }
 
@@ -63,294 +74,505 @@ void RoutingTable::debug(std::ostream& os) noexcept {
            << std::setw(15) << ip_to_str(route.next_hop)     //
            << std::setw(15) << route.metric << std::setw(15) //
            << (route.intf ? route.intf->name : "direct") << std::endl;
+        for (size_t i = 1; i < route.paths.size(); ++i) {
+            os << std::left << std::setw(30) << "" << std::setw(15) << ip_to_str(route.paths[i].addr) << std::setw(15)
+               << "" << route.paths[i].intf->name << std::endl;
+        }
     }
 
     // 打印拓扑
-    os << "Topology:" << std::endl;
-    for (auto& node : nodes) {
-        if (node.second.mask != 0) {
-            continue;
+    for (auto area : this_areas) {
+        os << "Topology (area " << ip_to_str(area->area_id) << "):" << std::endl;
+        for (auto& node : area->nodes) {
+            if (node.second.mask != 0) {
+                continue;
+            }
+            os << ip_to_str(node.second.id) << " -> " << std::endl;
+            for (auto& edge : area->out_edges(node.second.id)) {
+                os << "\t" << ip_to_str(edge.dst) << "(" << edge.metric << ") " << std::endl;
+            }
         }
-        os << ip_to_str(node.second.id) << " -> " << std::endl;
-        for (auto& edge : edges[node.second.id]) {
-            os << "\t" << ip_to_str(edge.dst) << "(" << edge.metric << ") " << std::endl;
+
+        // 打印路径
+        os << "Paths (area " << ip_to_str(area->area_id) << "):" << std::endl;
+        for (auto& node : area->nodes) {
+            if (node.second.mask == 0) {
+                continue;
+            }
+            in_addr_t prev = node.second.id;
+            while (prev != root_id && prev != 0) {
+                os << ip_to_str(prev) << " <- ";
+                prev = area->prevs[prev];
+            }
+            if (prev == 0) {
+                os << "unreachable" << std::endl;
+            }
+            os << ip_to_str(root_id) << std::endl;
         }
     }
+}
 
-    // 打印路径
-    os << "Paths:" << std::endl;
-    for (auto& node : nodes) {
-        if (node.second.mask == 0) {
+void RoutingTable::update_route() noexcept {
+    std::cout << "Updating route..." << std::endl;
+
+    // 各区域的区域内计算互不依赖，同时进行，N个区域大约只需最慢的那个区域的时间
+    std::vector<WorkerPool::Task> tasks;
+    for (auto area : this_areas) {
+        tasks.push_back([this, area] { area->run_spf(full_spf, verify_spf, max_paths); });
+    }
+    spf_workers.run(tasks);
+    // 邻居可能已经变化，下一跳重新解析
+    resolved_hops.clear();
+
+    auto intra_changed = std::any_of(this_areas.begin(), this_areas.end(), [](const Area *area) {
+        return area->intra_changed;
+    });
+    if (!intra_changed) {
+        // 只有Summary-LSA变化（rfc2328 16.5），各区域的最短路径树保持不变
+        update_inter_routes();
+        for (auto area : this_areas) {
+            area->release_snapshot();
+        }
+        publish_fib();
+        spf_partial_runs++;
+        std::cout << "Update route done." << std::endl;
+        return;
+    }
+
+    // 3-5 LSA
+    build_inter_routes();
+    // TODO: 构造外部路由
+    // 尽早放手，使LSDB不必再复制被引用的表
+    for (auto area : this_areas) {
+        area->release_snapshot();
+    }
+
+    // 将各区域的结点信息合并写入路由表
+    build_routes();
+    publish_fib();
+
+    update_kernel_route();
+    std::cout << "Update route done." << std::endl;
+}
+
+void RoutingTable::schedule_spf() noexcept {
+    std::lock_guard<std::mutex> lock(spf_mtx);
+    spf_triggers++;
+    if (spf_pending) {
+        spf_coalesced++;
+        return;
+    }
+    auto now = Clock::now();
+    spf_pending = true;
+    spf_trigger_time = now;
+    auto deadline = now + std::chrono::milliseconds(spf_delay_ms);
+    // 距上次计算不足hold时间，推迟到hold结束
+    if (spf_has_run && now - spf_last_run < std::chrono::milliseconds(spf_cur_hold_ms)) {
+        deadline = std::max(deadline, spf_last_run + std::chrono::milliseconds(spf_cur_hold_ms));
+    }
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+    // 到期时唤醒spf线程
+    this_timers.add(delay, [this]() {
+        std::lock_guard<std::mutex> lock(spf_mtx);
+        spf_ready = true;
+        spf_cv.notify_one();
+    });
+}
+
+bool RoutingTable::wait_spf() noexcept {
+    std::unique_lock<std::mutex> lock(spf_mtx);
+    while (!spf_stopped) {
+        if (!spf_ready) {
+            spf_cv.wait(lock);
             continue;
         }
-        in_addr_t prev = node.second.id;
-        while (prev != root_id && prev != 0) {
-            os << ip_to_str(prev) << " <- ";
-            prev = prevs[prev];
+        // 触发落在上一次的hold窗口内，hold加倍直到max wait；否则恢复初始值
+        if (spf_has_run && spf_trigger_time - spf_last_run < std::chrono::milliseconds(spf_cur_hold_ms)) {
+            spf_cur_hold_ms = std::min(spf_cur_hold_ms * 2, spf_max_wait_ms);
+        } else {
+            spf_cur_hold_ms = spf_hold_ms;
         }
-        if (prev == 0) {
-            os << "unreachable" << std::endl;
+        spf_pending = false;
+        spf_ready = false;
+        spf_has_run = true;
+        spf_last_run = Clock::now();
+        return true;
+    }
+    return false;
+}
+
+void RoutingTable::stop_spf() noexcept {
+    std::lock_guard<std::mutex> lock(spf_mtx);
+    spf_stopped = true;
+    spf_cv.notify_all();
+}
+
+void RoutingTable::print_stats(std::ostream& os) noexcept {
+    uint64_t full_runs = 0, incremental_runs = 0, verify_failures = 0;
+    for (auto area : this_areas) {
+        full_runs += area->spf_full_runs;
+        incremental_runs += area->spf_incremental_runs;
+        verify_failures += area->spf_verify_failures;
+    }
+    os << "SPF Statistics:" << std::endl
+       << "	areas: " << this_areas.size() << (is_abr() ? " (ABR)" : "") << std::endl
+       << "	triggers: " << spf_triggers << " (coalesced " << spf_coalesced << ")" << std::endl
+       << "	full runs: " << full_runs << std::endl
+       << "	incremental runs: " << incremental_runs << " (verify failures " << verify_failures << ")" << std::endl
+       << "	partial runs: " << spf_partial_runs << std::endl
+       << "	kernel adds/dels/replaces: " << fib_adds << "/" << fib_dels << "/" << fib_replaces << std::endl
+       << "	netlink msgs/batches/errors: " << netlink.msgs_sent << "/" << netlink.batches_sent << "/"
+       << netlink.errors << std::endl
+       << "	current hold: " << spf_cur_hold_ms << "ms" << std::endl;
+}
+
+// 由目的网络的所有Summary-LSA计算区域间路由，区域内路由优先
+// 读取各区域的lsdb快照，由调用者保证已取得
+bool RoutingTable::compute_inter_route(in_addr_t dst, InterRoute& route) noexcept {
+    // 已有区域内路由
+    for (auto area : this_areas) {
+        auto intra = area->nodes.find(dst);
+        if (intra != area->nodes.end() && intra->second.mask != 0 && intra->second.dist != UINT32_MAX) {
+            return false;
+        }
+    }
+
+    auto found = false;
+    uint32_t best_cost = UINT32_MAX;
+    for (auto area : summary_areas()) {
+        for (auto& lsa : area->snapshot->summary_lsas->get_all(dst)) {
+            // 如果是自己的LSA或已被清除
+            if (lsa->header.advertising_router == root_id || lsa->is_maxage()) {
+                continue;
+            }
+            auto it = area->nodes.find(lsa->header.advertising_router);
+            // 如果不存在或不可达
+            if (it == area->nodes.end() || it->second.dist == UINT32_MAX) {
+                continue;
+            }
+            // 路径长度不需要加lsa的metric，但按加上metric后的代价选择ABR
+            auto cost = it->second.dist + lsa->metric();
+            if (!found || cost < best_cost) {
+                route = {dst, lsa->network_mask(), it->second.dist, lsa->header.advertising_router, area};
+                best_cost = cost;
+                found = true;
+            }
         }
-        os << ip_to_str(root_id) << std::endl;
     }
+    return found;
 }
 
-void RoutingTable::update_route() noexcept {
-    std::cout << "Updating route..." << std::endl;
-    nodes.clear();
-    prevs.clear();
-    edges.clear();
-    reset_kernel_route();
-
-    // 从第一类和第二类LSA中记录结点信息
-    this_lsdb.lock();
-    for (auto& lsa : this_lsdb.router_lsas) {
-        // 对路由器结点，ls_id为其路由器id
-        nodes[lsa->header.link_state_id] = {lsa->header.link_state_id, UINT32_MAX};
-        // 记录路由器结点的出边
-        for (auto& link : lsa->links) {
-            if (link.type == LSA::LinkType::POINT2POINT) {
-                // 对点到点网络，link_id为对端路由器id
-                Edge edge(link.link_id, link.metric);
-                edges[lsa->header.link_state_id].push_back(edge);
-            } else if (link.type == LSA::LinkType::TRANSIT) {
-                // 对中转网络，link_id为该网络dr的接口ip
-                // 因此需要查Network LSA找到所有对应的网络结点
-                auto nlsa = this_lsdb.get_network_lsa(link.link_id);
-                if (nlsa == nullptr) {
-                    continue;
-                }
-                for (auto& router_id : nlsa->attached_routers) {
-                    if (router_id == lsa->header.link_state_id) {
-                        continue;
-                    }
-                    Edge edge(router_id, link.metric);
-                    edges[lsa->header.link_state_id].push_back(edge);
-                }
-            } else if (link.type == LSA::LinkType::STUB) {
-                // 对stub网络，link_id为网络ip，link_data为mask
-                // 需要新建一个结点
-                nodes[link.link_id] = {link.link_id, link.link_data, UINT32_MAX};
-                Edge edge(link.link_id, link.metric);
-                edges[lsa->header.link_state_id].push_back(edge);
-            } else {
-                // TODO: 暂时不考虑虚拟链路
+// 由Summary-LSA构造所有区域间路由
+// 读取各区域的lsdb快照，由调用者保证已取得
+void RoutingTable::build_inter_routes() noexcept {
+    inter_routes.clear();
+    for (auto area : summary_areas()) {
+        for (auto& lsa : *area->snapshot->summary_lsas) {
+            auto dst = lsa->header.link_state_id;
+            if (inter_routes.count(dst)) {
+                continue;
+            }
+            InterRoute route;
+            if (compute_inter_route(dst, route)) {
+                inter_routes[dst] = route;
             }
         }
     }
-    for (auto& lsa : this_lsdb.network_lsas) {
-        // 对网络结点，id本来是dr的接口ip，可能与路由器id相同
-        // 因此这里将网络结点的id按位与其mask，并用mask区分是否是网络结点
-        auto net_node_id = lsa->header.link_state_id & lsa->network_mask;
-        nodes[net_node_id] = {net_node_id, lsa->network_mask, UINT32_MAX};
-        // 路由器到网络结点的入边，距离为0
-        for (auto& router_id : lsa->attached_routers) {
-            Edge edge(net_node_id, 0);
-            edges[router_id].push_back(edge);
+}
+
+// 只重新计算Summary-LSA发生变化的目的网络，并只更新对应的内核路由
+// 读取各区域的lsdb快照和变化记录，由调用者保证已取得
+void RoutingTable::update_inter_routes() noexcept {
+    std::unordered_set<in_addr_t> dsts;
+    for (auto area : summary_areas()) {
+        for (auto& change : area->changes) {
+            if (change.type == LSA::Type::SUMMARY) {
+                dsts.insert(change.ls_id);
+            }
         }
     }
-    this_lsdb.unlock();
 
-    // 执行dijkstra算法
-    dijkstra();
+    for (auto& dst : dsts) {
+        bool had_old = false;
+        RouteKey old_key;
+        auto old = inter_routes.find(dst);
+        if (old != inter_routes.end()) {
+            had_old = true;
+            old_key = RouteKey(old->second.dst, old->second.mask);
+            auto it = inter_entries.find(old_key);
+            if (it != inter_entries.end()) {
+                routes.erase(it->second);
+                inter_entries.erase(it);
+            }
+            inter_routes.erase(old);
+        }
 
-    // 3-5 LSA
-    this_lsdb.lock();
-    // 构造区域间路由
-    for (auto& lsa : this_lsdb.summary_lsas) {
-        // 如果是自己的LSA
-        if (lsa->header.advertising_router == ntohl(inet_addr(THIS_ROUTER_ID))) {
-            continue;
+        bool has_new = false;
+        InterRoute route;
+        Entry entry{};
+        if (compute_inter_route(dst, route)) {
+            inter_routes[dst] = route;
+            if (make_inter_entry(route, entry)) {
+                inter_entries[RouteKey(entry.dst, entry.mask)] = routes.insert(routes.end(), entry);
+                has_new = true;
+            }
         }
-        auto it = nodes.find(lsa->header.advertising_router);
-        // 如果不存在
-        if (it == nodes.end()) {
-            continue;
+
+        // 同一前缀先写入新路由再删除旧路由
+        auto new_key = RouteKey(entry.dst, entry.mask);
+        if (has_new) {
+            sync_kernel_route(new_key, &entry);
         }
-        auto abr_node = it->second;
-        // 如果不可达
-        if (abr_node.dist == UINT32_MAX) {
+        if (had_old && !(has_new && new_key == old_key)) {
+            sync_kernel_route(old_key, nullptr);
+        }
+    }
+    flush_kernel_route();
+}
+
+// 由本端接口地址找到出接口，再在该接口上查邻居的地址
+static Interface *resolve_neighbor(Area *area, const Area::Hop& first_hop, in_addr_t& next_hop) {
+    for (auto& intf : area->interfaces) {
+        if (intf->ip_addr != first_hop.intf_addr) {
             continue;
         }
-        // 路径长度不需要加lsa的metric
-        Node net_node(lsa->header.link_state_id, lsa->network_mask, nodes[abr_node.id].dist); // + lsa->metric);
-        nodes[net_node.id] = net_node;
-        Edge edge(net_node.id, lsa->metric);
-        edges[abr_node.id].push_back(edge);
-        prevs[net_node.id] = abr_node.id;
+        auto nbr = intf->get_neighbor_by_id(first_hop.nbr_id);
+        if (nbr == nullptr) {
+            return nullptr;
+        }
+        next_hop = nbr->ip_addr;
+        return intf;
     }
-    // TODO: 构造外部路由
-    this_lsdb.unlock();
+    return nullptr;
+}
 
-    // 将结点信息写入路由表
-    routes.clear();
-    for (auto& pair : nodes) {
-        auto& node = pair.second;
+const RoutingTable::NextHop& RoutingTable::resolve_hop(Area *area, const Area::Hop& first_hop) noexcept {
+    auto& hops = resolved_hops[area];
+    auto key = (uint64_t)first_hop.nbr_id << 32 | first_hop.intf_addr;
+    auto it = hops.find(key);
+    if (it == hops.end()) {
+        NextHop hop{0, nullptr};
+        hop.intf = resolve_neighbor(area, first_hop, hop.addr);
+        it = hops.emplace(key, hop).first;
+    }
+    return it->second;
+}
 
-        // 路由表只关心网络结点和存根网络
-        if (node.mask == 0) {
-            continue;
+// 将区域内结点的直接后继解析为下一跳地址和接口，填入entry，无可用下一跳时返回false
+bool RoutingTable::resolve_paths(Area *area, const std::vector<Area::Hop>& first_hops, Entry& entry) noexcept {
+    entry.paths.clear();
+    for (auto& first_hop : first_hops) {
+        auto& hop = resolve_hop(area, first_hop);
+        if (hop.intf != nullptr) {
+            entry.paths.push_back(hop);
         }
-        in_addr_t dst = node.id;
-        in_addr_t mask = node.mask;
-        in_addr_t next_hop = 0;
-        uint32_t metric = node.dist;
-        Interface *interface = nullptr;
-
-        // 查找下一跳的地址和自身接口
-        if (prevs[dst] != root_id) {
-            in_addr_t prev_hop = prevs[dst];
-            in_addr_t next_id = dst;
-            while (prev_hop != root_id && prev_hop != 0) {
-                next_id = prev_hop;
-                prev_hop = prevs[prev_hop];
-            }
-            if (prev_hop == 0) {
+    }
+    if (entry.paths.empty()) {
+        return false;
+    }
+    entry.next_hop = entry.paths[0].addr;
+    entry.intf = entry.paths[0].intf;
+    if (entry.paths.size() == 1) {
+        entry.paths.clear();
+    }
+    return true;
+}
+
+// 经由ABR的区域间路由表项
+bool RoutingTable::make_inter_entry(const InterRoute& route, Entry& entry) noexcept {
+    entry = Entry(route.dst, route.mask, 0, route.dist, nullptr);
+    auto it = route.area->nodes.find(route.abr);
+    if (it == route.area->nodes.end()) {
+        return false;
+    }
+    return resolve_paths(route.area, it->second.first_hops, entry);
+}
+
+void RoutingTable::build_routes() noexcept {
+    routes.clear();
+    inter_entries.clear();
+    // 同一网络可能出现在多个区域中，只保留度量最小的
+    std::map<RouteKey, std::list<Entry>::iterator> intra;
+
+    for (auto area : this_areas) {
+        for (auto& pair : area->nodes) {
+            auto& node = pair.second;
+
+            // 路由表只关心网络结点和存根网络
+            if (node.mask == 0 || node.dist == UINT32_MAX) {
                 continue;
             }
-            // 查邻居对应的接口
-            for (auto& intf : this_interfaces) {
-                auto nbr = intf->get_neighbor_by_id(next_id);
-                if (nbr) {
-                    next_hop = nbr->ip_addr;
-                    interface = intf;
-                    break;
+            Entry entry(node.id, node.mask, 0, node.dist, nullptr);
+
+            // 查找下一跳的地址和自身接口
+            if (area->prevs[node.id] != root_id) {
+                if (!resolve_paths(area, node.first_hops, entry)) {
+                    continue;
                 }
-            }
-        } else {
-            next_hop = 0;
-            for (auto& intf : this_interfaces) {
-                if (dst == (intf->ip_addr & intf->mask)) {
-                    interface = intf;
-                    break;
+            } else {
+                for (auto& intf : area->interfaces) {
+                    if (node.id == (intf->ip_addr & intf->mask)) {
+                        entry.intf = intf;
+                        break;
+                    }
                 }
             }
-        }
 
-        // 无论是直连还是间接，都要有接口
-        assert(interface != nullptr);
+            // 无论是直连还是间接，都要有接口
+            assert(entry.intf != nullptr);
 
-        Entry entry(dst, mask, next_hop, metric, interface);
-        routes.push_back(entry);
+            auto key = RouteKey(entry.dst, entry.mask);
+            auto it = intra.find(key);
+            if (it == intra.end()) {
+                intra.emplace(key, routes.insert(routes.end(), entry));
+            } else if (entry.metric < it->second->metric) {
+                *it->second = entry;
+            }
+        }
     }
 
-    update_kernel_route();
-    std::cout << "Update route done." << std::endl;
+    for (auto& pair : inter_routes) {
+        Entry entry;
+        if (make_inter_entry(pair.second, entry)) {
+            inter_entries[RouteKey(entry.dst, entry.mask)] = routes.insert(routes.end(), entry);
+        }
+    }
 }
 
-void RoutingTable::dijkstra() noexcept {
-    auto heap = std::priority_queue<Node, std::vector<Node>, std::greater<Node>>();
-    std::unordered_map<in_addr_t, bool> vis;
-
-    // 初始化前驱结点和访问标记
-    for (auto& node : nodes) {
-        prevs[node.first] = 0;
-        vis[node.first] = false;
+std::vector<NetlinkRoute::Nexthop> RoutingTable::make_nexthops(const Entry& entry) {
+    std::vector<NetlinkRoute::Nexthop> nexthops;
+    if (entry.paths.empty()) {
+        nexthops.emplace_back(entry.next_hop, entry.intf->if_index);
     }
+    for (auto& path : entry.paths) {
+        nexthops.emplace_back(path.addr, path.intf->if_index);
+    }
+    return nexthops;
+}
 
-    // 初始化根节点
-    nodes[root_id].dist = 0;
-    heap.push(nodes[root_id]);
-
-    // 计算最短路径
-    while (!heap.empty()) {
-        auto node = heap.top();
-        heap.pop();
-        if (vis[node.id]) {
-            continue;
-        }
-        vis[node.id] = true;
+static rtentry make_rtentry(in_addr_t dst, in_addr_t mask, in_addr_t next_hop, uint32_t metric, Interface *intf) {
+    rtentry rtentry;
+    memset(&rtentry, 0, sizeof(rtentry));
+
+    rtentry.rt_dst.sa_family = AF_INET;
+    ((sockaddr_in *)&rtentry.rt_dst)->sin_addr.s_addr = htonl(dst);
+    rtentry.rt_genmask.sa_family = AF_INET;
+    ((sockaddr_in *)&rtentry.rt_genmask)->sin_addr.s_addr = htonl(mask);
+    rtentry.rt_gateway.sa_family = AF_INET;
+    ((sockaddr_in *)&rtentry.rt_gateway)->sin_addr.s_addr = htonl(next_hop);
+    rtentry.rt_metric = metric;
+    rtentry.rt_flags = next_hop == 0 ? RTF_UP : RTF_UP | RTF_GATEWAY;
+    rtentry.rt_dev = intf->name;
+    return rtentry;
+}
 
-        for (auto& edge : edges[node.id]) {
-            if (nodes[edge.dst].dist > node.dist + edge.metric) {
-                nodes[edge.dst].dist = node.dist + edge.metric;
-                prevs[edge.dst] = node.id;
-                heap.push(nodes[edge.dst]);
-            }
-        }
+// ioctl无法表达多路径，只写入第一个下一跳
+bool RoutingTable::kernel_add(const Entry& entry) {
+    if (netlink.is_open()) {
+        netlink.add(entry.dst, entry.mask, make_nexthops(entry), entry.metric, (uint64_t)entry.dst << 32 | entry.mask);
+        fib_adds++;
+        return true;
     }
+    auto rtentry = make_rtentry(entry.dst, entry.mask, entry.next_hop, entry.metric, entry.intf);
+    if (ioctl(kernel_route_fd, SIOCADDRT, &rtentry) < 0) {
+        perror("write kernel route failed");
+        std::cout << "-- dst: " << ip_to_str(entry.dst) << std::endl;
+        std::cout << "-- mask: " << ip_to_str(entry.mask) << std::endl;
+        std::cout << "-- next_hop: " << ip_to_str(entry.next_hop) << std::endl;
+        return false;
+    }
+    fib_adds++;
+    return true;
 }
 
-void RoutingTable::update_kernel_route() {
-    for (auto& entry : routes) {
-        rtentry rtentry;
-        memset(&rtentry, 0, sizeof(rtentry));
+bool RoutingTable::kernel_del(const Entry& entry) {
+    if (netlink.is_open()) {
+        netlink.del(entry.dst, entry.mask, make_nexthops(entry), entry.metric);
+        fib_dels++;
+        return true;
+    }
+    auto rtentry = make_rtentry(entry.dst, entry.mask, entry.next_hop, entry.metric, entry.intf);
+    if (ioctl(kernel_route_fd, SIOCDELRT, &rtentry) < 0) {
+        perror("remove kernel route failed");
+        return false;
+    }
+    fib_dels++;
+    return true;
+}
 
-        // 如果是直连，优先写入
-        if (entry.next_hop == 0) {
-            rtentry.rt_flags = RTF_UP;
+// 使内核中key对应的路由与entry一致，entry为空表示删除
+void RoutingTable::sync_kernel_route(const RouteKey& key, const Entry *entry) {
+    auto it = kernel_routes.find(key);
+    if (entry == nullptr) {
+        if (it != kernel_routes.end()) {
+            kernel_del(it->second);
+            kernel_routes.erase(it);
         }
-
-        // 设置
-        rtentry.rt_dst.sa_family = AF_INET;
-        ((sockaddr_in *)&rtentry.rt_dst)->sin_addr.s_addr = htonl(entry.dst);
-        rtentry.rt_genmask.sa_family = AF_INET;
-        ((sockaddr_in *)&rtentry.rt_genmask)->sin_addr.s_addr = htonl(entry.mask);
-        rtentry.rt_gateway.sa_family = AF_INET;
-        ((sockaddr_in *)&rtentry.rt_gateway)->sin_addr.s_addr = htonl(entry.next_hop);
-        rtentry.rt_metric = entry.metric;
-        
-        // if (entry.next_hop == 0) {
-        //     rtentry.rt_flags = RTF_UP;
-        // } else {
-        //     rtentry.rt_flags = RTF_UP | RTF_GATEWAY;
-        // }
-        rtentry.rt_dev = entry.intf->name;
-
-        // 写入
-        if (ioctl(kernel_route_fd, SIOCADDRT, &rtentry) < 0) {
-            perror("write kernel route failed");
-            std::cout << "-- dst: " << ip_to_str(entry.dst) << std::endl;
-            std::cout << "-- mask: " << ip_to_str(entry.mask) << std::endl;
-            std::cout << "-- next_hop: " << ip_to_str(entry.next_hop) << std::endl;
-        } else {
-            // 备份
-            kernel_routes.push_back(rtentry);
+        return;
+    }
+    if (it == kernel_routes.end()) {
+        if (kernel_add(*entry)) {
+            kernel_routes.emplace(key, *entry);
+        }
+        return;
+    }
+    if (it->second.same_path(*entry)) {
+        return;
+    }
+    // ioctl只写入了第一个下一跳，仅其余等价路径变化时内核中的路由不变，只更新记录
+    if (!netlink.is_open() && it->second.same_first_path(*entry)) {
+        it->second = *entry;
+        return;
+    }
+    // 先写入新路由再删除旧路由，替换过程中不会出现黑洞
+    // netlink以NLM_F_REPLACE写入时，度量相同的旧路由已被原地替换
+    if (kernel_add(*entry)) {
+        if (!netlink.is_open() || it->second.metric != entry->metric) {
+            kernel_del(it->second);
         }
+        it->second = *entry;
+        fib_replaces++;
     }
+}
 
+// 发出netlink缓冲区中的消息，写入失败的路由从已写入集合中去掉，下次计算时重试
+void RoutingTable::flush_kernel_route() {
+    for (auto tag : netlink.flush()) {
+        kernel_routes.erase(RouteKey(tag >> 32, tag & 0xffffffff));
+    }
+}
+
+// 将路由表与已写入内核的路由比较，只写入新增、删除和变化的路由
+void RoutingTable::update_kernel_route() {
+    std::map<RouteKey, const Entry *> wanted;
     for (auto& entry : routes) {
-        // 然后写入非直连
+        // 直连网络的路由由内核随接口地址维护，不写入也不删除，否则会覆盖或删掉内核自己的路由
         if (entry.next_hop == 0) {
             continue;
         }
-        rtentry rtentry;
-        memset(&rtentry, 0, sizeof(rtentry));
-
-        // 设置
-        rtentry.rt_dst.sa_family = AF_INET;
-        ((sockaddr_in *)&rtentry.rt_dst)->sin_addr.s_addr = htonl(entry.dst);
-        rtentry.rt_genmask.sa_family = AF_INET;
-        ((sockaddr_in *)&rtentry.rt_genmask)->sin_addr.s_addr = htonl(entry.mask);
-        rtentry.rt_gateway.sa_family = AF_INET;
-        ((sockaddr_in *)&rtentry.rt_gateway)->sin_addr.s_addr = htonl(entry.next_hop);
-        rtentry.rt_metric = entry.metric;
-        rtentry.rt_flags = RTF_UP | RTF_GATEWAY;
-        rtentry.rt_dev = entry.intf->name;
-
-        // 写入
-        if (ioctl(kernel_route_fd, SIOCADDRT, &rtentry) < 0) {
-            perror("write kernel route failed");
-            std::cout << "-- dst: " << ip_to_str(entry.dst) << std::endl;
-            std::cout << "-- mask: " << ip_to_str(entry.mask) << std::endl;
-            std::cout << "-- next_hop: " << ip_to_str(entry.next_hop) << std::endl;
-        } else {
-            // 备份
-            kernel_routes.push_back(rtentry);
+        wanted.emplace(RouteKey(entry.dst, entry.mask), &entry);
+    }
+    for (auto& pair : wanted) {
+        sync_kernel_route(pair.first, pair.second);
+    }
+
+    // 删除不再存在的路由
+    std::vector<RouteKey> stale;
+    for (auto& pair : kernel_routes) {
+        if (!wanted.count(pair.first)) {
+            stale.push_back(pair.first);
         }
     }
+    for (auto& key : stale) {
+        sync_kernel_route(key, nullptr);
+    }
+    flush_kernel_route();
 }
 
 void RoutingTable::reset_kernel_route() {
-    for (auto& rtentry : kernel_routes) {
-        // 如果直连，不删除
-        if (!(rtentry.rt_flags & RTF_GATEWAY)) {
-            continue;
-        }
-
-        if (ioctl(kernel_route_fd, SIOCDELRT, &rtentry) < 0) {
-            perror("remove kernel route failed");
-        }
+    for (auto& pair : kernel_routes) {
+        kernel_del(pair.second);
     }
+    netlink.flush();
     kernel_routes.clear();
-}
\ No newline at end of file
+}
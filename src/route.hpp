@@ -1,7 +1,13 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -10,6 +16,12 @@
 #include <netinet/in.h>
 #include <unistd.h>
 
+#include "area.hpp"
+#include "fib.hpp"
+#include "lsdb.hpp"
+#include "netlink.hpp"
+#include "workers.hpp"
+
 class Interface;
 namespace LSA {
 class Base;
@@ -19,24 +31,52 @@ class Base;
 // 这里不再使用linux的路由表，而是自己维护一个路由表
 class RoutingTable {
 private:
+    struct NextHop {
+        in_addr_t addr;
+        Interface *intf;
+        bool operator==(const NextHop& rhs) const noexcept {
+            return addr == rhs.addr && intf == rhs.intf;
+        }
+    };
+
     struct Entry {
         in_addr_t dst;
         in_addr_t mask;
         in_addr_t next_hop; // 若直连，则为0
         uint32_t metric;
         Interface *intf;
+        // 等价多路径的全部下一跳（第一个即next_hop/intf），单路径时为空
+        std::vector<NextHop> paths;
 
         Entry() = default;
         Entry(in_addr_t dst, in_addr_t mask, in_addr_t next_hop, uint32_t metric, Interface *intf)
             : dst(dst), mask(mask), next_hop(next_hop), metric(metric), intf(intf) {
         }
         ~Entry() = default;
+
+        /* 下一跳、度量和出接口相同，即无需重写内核 */
+        bool same_path(const Entry& rhs) const noexcept {
+            return same_first_path(rhs) && paths == rhs.paths;
+        }
+        /* 只比较第一个下一跳，ioctl写入的内核路由只包含这部分 */
+        bool same_first_path(const Entry& rhs) const noexcept {
+            return next_hop == rhs.next_hop && metric == rhs.metric && intf == rhs.intf;
+        }
     };
 
+    /* (dst, mask) */
+    using RouteKey = std::pair<in_addr_t, in_addr_t>;
+
     std::list<Entry> routes;
+    // 区域间路由在routes中的位置，增量更新时直接删除，不必遍历routes
+    std::map<RouteKey, std::list<Entry>::iterator> inter_entries;
+    // 由routes构建的最长前缀匹配表，每次计算后整体替换，供其它线程无锁查找
+    std::shared_ptr<const PrefixTrie> fib;
+    void publish_fib();
 
 public:
     RoutingTable() {
+        fib = std::make_shared<const PrefixTrie>();
         // 添加代表自己的根结点
         root_id = ntohl(inet_addr(THIS_ROUTER_ID));
         kernel_route_fd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -44,6 +84,10 @@ public:
             perror("init kernel route fd failed");
             exit(1); // 直接退出
         }
+        // 优先使用netlink批量写入，并清理上次运行残留的路由
+        if (netlink.open()) {
+            netlink.purge();
+        }
     }
     ~RoutingTable() {
         reset_kernel_route();
@@ -55,48 +99,102 @@ public:
     void debug(std::ostream& os) noexcept;
 
 private:
-    struct Node {
-        in_addr_t id;
-        in_addr_t mask = 0;
-        uint32_t dist;
-        Node() = default;
-        Node(in_addr_t id, uint32_t dist) : id(id), dist(dist) {
-        }
-        Node(in_addr_t id, in_addr_t mask, uint32_t dist) : id(id), mask(mask), dist(dist) {
-        }
-        bool operator>(const Node& rhs) const noexcept {
-            return dist > rhs.dist;
-        }
-    };
+    uint32_t root_id;
 
-    struct Edge {
+    // 区域间路由（来自Summary-LSA），不进入最短路径树
+    struct InterRoute {
         in_addr_t dst;
-        uint32_t metric;
-        Edge() = default;
-        Edge(in_addr_t dst, uint32_t metric) : dst(dst), metric(metric) {
-        }
+        in_addr_t mask;
+        uint32_t dist;
+        in_addr_t abr;
+        // ABR所在的区域，下一跳由该区域的最短路径树求出
+        Area *area;
     };
+    std::unordered_map<in_addr_t, InterRoute> inter_routes;
+
+    // 各区域的区域内计算在其中并行执行
+    WorkerPool spf_workers;
+
+    bool compute_inter_route(in_addr_t dst, InterRoute& route) noexcept;
+    void build_inter_routes() noexcept;
+    void update_inter_routes() noexcept;
+    // 根的直接后继解析得到的下一跳，以nbr_id << 32 | intf_addr为键，
+    // 每次计算路由表时每个区域的每个(邻居, 出接口)只解析一次
+    std::unordered_map<Area *, std::unordered_map<uint64_t, NextHop>> resolved_hops;
+    const NextHop& resolve_hop(Area *area, const Area::Hop& first_hop) noexcept;
+    bool resolve_paths(Area *area, const std::vector<Area::Hop>& first_hops, Entry& entry) noexcept;
+    bool make_inter_entry(const InterRoute& route, Entry& entry) noexcept;
+    void build_routes() noexcept;
 
-    uint32_t root_id;
-
-    // 路由器结点和网络结点
-    std::unordered_map<in_addr_t, Node> nodes;
-    // 每个结点的前驱结点
-    std::unordered_map<in_addr_t, in_addr_t> prevs;
-    // 每个结点的出边，其中网络结点不应有出边
-    std::unordered_map<in_addr_t, std::vector<Edge>> edges;
+public:
+    /* 总是全量计算（关闭增量SPF） */
+    bool full_spf = false;
+    /* 增量计算后再做一次全量计算并比对结果 */
+    bool verify_spf = false;
+    /* 每个目的网络最多使用的等价路径数 */
+    uint32_t max_paths = 4;
+    /* 区域内计算最多使用的线程数，0为硬件线程数 */
+    void set_spf_threads(size_t threads) noexcept {
+        spf_workers.max_threads = threads;
+    }
 
-    void dijkstra() noexcept;
+    /* SPF统计，全量和增量计算的次数由各区域分别记录 */
+    uint64_t spf_partial_runs = 0;
 
 private:
     /* 内核路由表相关 */
-    std::list<rtentry> kernel_routes;
+    // 已写入内核的路由，与新的路由表比较后只写入差异
+    std::map<RouteKey, Entry> kernel_routes;
     int kernel_route_fd;
+    // 打开失败时退回ioctl逐条写入
+    NetlinkRoute netlink;
     void update_kernel_route();
+    void flush_kernel_route();
     void reset_kernel_route();
+    void sync_kernel_route(const RouteKey& key, const Entry *entry);
+    bool kernel_add(const Entry& entry);
+    bool kernel_del(const Entry& entry);
+    static std::vector<NetlinkRoute::Nexthop> make_nexthops(const Entry& entry);
 
 public:
+    /* 内核路由写入统计 */
+    uint64_t fib_adds = 0;
+    uint64_t fib_dels = 0;
+    uint64_t fib_replaces = 0;
+
     void update_route() noexcept;
+
+private:
+    /* SPF调度相关 */
+    using Clock = std::chrono::steady_clock;
+    std::mutex spf_mtx;
+    std::condition_variable spf_cv;
+    bool spf_pending = false;
+    // 节流窗口已到期，spf线程可以计算
+    bool spf_ready = false;
+    bool spf_stopped = false;
+    bool spf_has_run = false;
+    Clock::time_point spf_trigger_time;
+    Clock::time_point spf_last_run;
+    uint32_t spf_cur_hold_ms = 0;
+
+public:
+    /* SPF节流：首次触发延迟、两次计算的最小间隔、间隔指数退避的上限，单位毫秒 */
+    uint32_t spf_delay_ms = 50;
+    uint32_t spf_hold_ms = 200;
+    uint32_t spf_max_wait_ms = 5000;
+
+    /* 触发次数和被合并到同一次计算中的触发次数 */
+    uint64_t spf_triggers = 0;
+    uint64_t spf_coalesced = 0;
+
+    /* 标记SPT过时，在节流窗口到期后计算一次 */
+    void schedule_spf() noexcept;
+    /* 阻塞直到需要计算，停止时返回false */
+    bool wait_spf() noexcept;
+    void stop_spf() noexcept;
+
+    void print_stats(std::ostream& os) noexcept;
 };
 
 extern RoutingTable this_routing_table;
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <iterator>
+
+#include "timer.hpp"
+
+TimerWheel this_timers;
+
+static constexpr uint64_t NEVER = UINT64_MAX;
+
+TimerWheel::TimerWheel() : start(Clock::now()) {
+}
+
+uint64_t TimerWheel::now_tick() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+// 选择满足 (expire >> 6L) - (cur >> 6L) < 64 的最低层L，保证该槽在绕回之前被处理
+void TimerWheel::place(Timer&& timer) {
+    int level = 0;
+    uint64_t index = timer.expire;
+    for (; level < LEVELS; ++level) {
+        auto shift = level * SLOT_BITS;
+        index = timer.expire >> shift;
+        if (index - (cur >> shift) < SLOTS) {
+            break;
+        }
+    }
+    if (level == LEVELS) {
+        // 超出范围，挂在最高层最远的槽，下放时重新计算
+        level = LEVELS - 1;
+        index = (cur >> (level * SLOT_BITS)) + SLOTS - 1;
+    }
+    auto slot = index & (SLOTS - 1);
+    auto& list = wheel[level][slot];
+    auto id = timer.id;
+    list.push_back(std::move(timer));
+    occupied[level] |= 1ull << slot;
+    timers[id] = {level, (int)slot, std::prev(list.end())};
+}
+
+void TimerWheel::unlink(int level, int slot, Slot::iterator it) {
+    auto& list = wheel[level][slot];
+    list.erase(it);
+    if (list.empty()) {
+        occupied[level] &= ~(1ull << slot);
+    }
+}
+
+TimerWheel::TimerId TimerWheel::add(uint32_t delay_ms, Callback cb) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto id = next_id++;
+    // 不早于下一个未处理的tick
+    auto expire = std::max(now_tick() + delay_ms, cur + 1);
+    place({id, expire, std::move(cb)});
+    cv.notify_one();
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = timers.find(id);
+    if (it == timers.end()) {
+        // 已到期但回调还未执行，run()执行前会跳过它
+        return due_ids.erase(id) > 0;
+    }
+    unlink(it->second.level, it->second.slot, it->second.it);
+    timers.erase(it);
+    return true;
+}
+
+size_t TimerWheel::size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return timers.size();
+}
+
+// cur之后第一个需要处理的tick：第0层槽到期，或更高层的槽需要下放
+uint64_t TimerWheel::next_tick() const {
+    auto next = NEVER;
+    for (int level = 0; level < LEVELS; ++level) {
+        if (occupied[level] == 0) {
+            continue;
+        }
+        auto shift = level * SLOT_BITS;
+        auto base = cur >> shift;
+        auto pos = base & (SLOTS - 1);
+        // 将位图循环右移，使cur的下一个槽成为第0位
+        auto shift_bits = (pos + 1) & (SLOTS - 1);
+        auto rot = occupied[level];
+        if (shift_bits != 0) {
+            rot = rot >> shift_bits | rot << (SLOTS - shift_bits);
+        }
+        auto dist = (uint64_t)__builtin_ctzll(rot) + 1;
+        next = std::min(next, (base + dist) << shift);
+    }
+    return next;
+}
+
+// 处理tick：先由高到低下放到期的槽，再收集第0层到期的定时器
+void TimerWheel::process(uint64_t tick, Due& due) {
+    cur = tick;
+    for (int level = LEVELS - 1; level > 0; --level) {
+        auto shift = level * SLOT_BITS;
+        if ((tick & ((1ull << shift) - 1)) != 0) {
+            continue;
+        }
+        auto slot = (tick >> shift) & (SLOTS - 1);
+        if (!(occupied[level] & (1ull << slot))) {
+            continue;
+        }
+        Slot list;
+        list.swap(wheel[level][slot]);
+        occupied[level] &= ~(1ull << slot);
+        for (auto& timer : list) {
+            place(std::move(timer));
+        }
+    }
+
+    auto slot = tick & (SLOTS - 1);
+    auto& list = wheel[0][slot];
+    for (auto it = list.begin(); it != list.end();) {
+        if (it->expire > tick) {
+            ++it;
+            continue;
+        }
+        due.emplace_back(it->id, std::move(it->cb));
+        due_ids.insert(it->id);
+        timers.erase(it->id);
+        it = list.erase(it);
+    }
+    if (list.empty()) {
+        occupied[0] &= ~(1ull << slot);
+    }
+}
+
+void TimerWheel::run() {
+    Due due;
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopped) {
+        // 跳过没有事件的tick，处理到当前时刻
+        auto now = now_tick();
+        while (true) {
+            auto next = next_tick();
+            if (next > now) {
+                cur = std::max(cur, now);
+                break;
+            }
+            process(next, due);
+        }
+
+        if (!due.empty()) {
+            for (auto& pair : due) {
+                // 前面的回调可能已取消了它
+                if (due_ids.erase(pair.first) == 0) {
+                    continue;
+                }
+                lock.unlock();
+                pair.second();
+                lock.lock();
+            }
+            due.clear();
+            continue;
+        }
+
+        auto next = next_tick();
+        if (next == NEVER) {
+            cv.wait(lock);
+        } else {
+            cv.wait_until(lock, start + std::chrono::milliseconds(next));
+        }
+    }
+}
+
+void TimerWheel::stop() {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopped = true;
+    cv.notify_one();
+}
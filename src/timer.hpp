@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "pool.hpp"
+
+// 分层时间轮，毫秒精度
+// 4层、每层64个槽，第L层每个槽覆盖64^L毫秒，共约4.6小时，更远的定时器先挂在最高层，到期前再逐层下放
+// 添加和取消均为O(1)；run()所在线程睡眠到下一个需要处理的时刻
+// 回调在run()所在线程中、不持有时间轮的锁执行，回调中可以再添加或取消定时器
+// 已到期但回调尚未执行的定时器仍可取消，执行前会在锁内再检查一次
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+    /* 定时器标识，0表示无效 */
+    using TimerId = uint64_t;
+
+    TimerWheel();
+    ~TimerWheel() = default;
+
+    /* delay_ms毫秒后执行一次cb */
+    TimerId add(uint32_t delay_ms, Callback cb);
+    /* 取消定时器，已执行或不存在时返回false */
+    bool cancel(TimerId id);
+    /* 取消定时器并将id置0 */
+    void cancel_and_reset(TimerId& id) {
+        if (id != 0) {
+            cancel(id);
+            id = 0;
+        }
+    }
+
+    /* 处理到期的定时器，直到stop() */
+    void run();
+    void stop();
+
+    /* 当前挂起的定时器数量 */
+    size_t size();
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+
+    struct Timer {
+        TimerId id;
+        uint64_t expire; // 到期的tick
+        Callback cb;
+    };
+    using Slot = PoolList<Timer>;
+    using Due = std::vector<std::pair<TimerId, Callback>>;
+    struct Location {
+        int level;
+        int slot;
+        Slot::iterator it;
+    };
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopped = false;
+
+    Clock::time_point start;
+    // 已处理到的tick（毫秒）
+    uint64_t cur = 0;
+    TimerId next_id = 1;
+
+    Slot wheel[LEVELS][SLOTS];
+    // 每层非空槽的位图
+    uint64_t occupied[LEVELS] = {};
+    PoolMap<TimerId, Location> timers;
+    // 已从时间轮取出、回调尚未执行的定时器，取消时从中删除
+    std::unordered_set<TimerId> due_ids;
+
+    uint64_t now_tick() const;
+    void place(Timer&& timer);
+    void unlink(int level, int slot, Slot::iterator it);
+    uint64_t next_tick() const;
+    void process(uint64_t tick, Due& due);
+};
+
+extern TimerWheel this_timers;
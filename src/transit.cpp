@@ -1,21 +1,28 @@
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstddef>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <thread>
+#include <vector>
 
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <netinet/if_ether.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include "interface.hpp"
 #include "lsdb.hpp"
 #include "neighbor.hpp"
+#include "route.hpp"
+#include "timer.hpp"
 #include "transit.hpp"
 
 namespace OSPF {
@@ -23,129 +30,246 @@ namespace OSPF {
 std::atomic<bool> running(false);
 // int recv_fd;
 
-void recv_loop() {
-    iphdr *ip_hdr;
-    Interface *intf;
-    char recv_frame[ETH_FRAME_LEN];
+/* 用于唤醒recv线程的eventfd，由stop()写入
+ * 在启动线程之前创建、recv线程结束之后关闭，线程运行期间只读，不需要同步 */
+static int wakeup_fd = -1;
+
+void open_wakeup() {
+    wakeup_fd = eventfd(0, EFD_NONBLOCK);
+    if (wakeup_fd < 0) {
+        perror("open_wakeup: eventfd");
+    }
+}
+
+void close_wakeup() {
+    if (wakeup_fd >= 0) {
+        close(wakeup_fd);
+        wakeup_fd = -1;
+    }
+}
+
+// 解析并分发一个以太网帧
+static void handle_frame(Interface *intf, char *recv_frame, ssize_t recv_size) {
     auto recv_packet = recv_frame + sizeof(ethhdr);
-    while (running) {
-        for (auto& intf : this_interfaces) {
-            memset(recv_frame, 0, ETH_FRAME_LEN);
+    if (recv_size < static_cast<ssize_t>(sizeof(ethhdr) + sizeof(iphdr))) {
+        return;
+    }
+    intf->rx_frames++;
 
-            // auto recv_size = recv(recv_fd, recv_frame, ETH_FRAME_LEN, 0);
-            auto recv_size = recvfrom(intf->recv_fd, recv_frame, ETH_FRAME_LEN, 0, nullptr, nullptr);
-            if (recv_size < sizeof(iphdr)) {
-                perror("recv_loop: not receive enough data");
-            }
+    // 解析IP头部
+    auto ip_hdr = reinterpret_cast<iphdr *>(recv_packet);
+    auto src_ip = ntohl(ip_hdr->saddr);
+    auto dst_ip = ntohl(ip_hdr->daddr);
 
-            // 解析IP头部
-            ip_hdr = reinterpret_cast<iphdr *>(recv_packet);
-            auto src_ip = ntohl(ip_hdr->saddr);
-            auto dst_ip = ntohl(ip_hdr->daddr);
+    // 处理ICMP数据包
+    // if (ip_hdr->protocol == IPPROTO_ICMP) {
+    //     forward_icmp(recv_packet, recv_size, src_ip, dst_ip);
+    //     return;
+    // }
 
-            // 处理ICMP数据包
-            // if (ip_hdr->protocol == IPPROTO_ICMP) {
-            //     forward_icmp(recv_packet, recv_size, src_ip, dst_ip);
-            //     continue;
-            // }
+    // 如果不是OSPF协议的数据包
+    if (ip_hdr->protocol != IPPROTO_OSPF) {
+        return;
+    }
 
-            // 如果不是OSPF协议的数据包
-            if (ip_hdr->protocol != IPPROTO_OSPF) {
-                continue;
-            }
+    // 丢弃截断或校验和错误的报文
+    auto ip_hdr_len = ip_hdr->ihl * 4u;
+    if (recv_size < static_cast<ssize_t>(sizeof(ethhdr) + ip_hdr_len)) {
+        return;
+    }
+    auto ospf_packet = recv_packet + ip_hdr_len;
+    if (!verify_packet(ospf_packet, recv_size - sizeof(ethhdr) - ip_hdr_len)) {
+        intf->rx_bad_packets++;
+        return;
+    }
 
-            auto ospf_hdr = reinterpret_cast<OSPF::Header *>(recv_packet + sizeof(iphdr));
-            ospf_hdr->network_to_host();
+    auto ospf_hdr = reinterpret_cast<OSPF::Header *>(ospf_packet);
+    ospf_hdr->network_to_host();
 
-            // 如果是本机发送的数据包
-            if (ospf_hdr->router_id == ntohl(inet_addr(THIS_ROUTER_ID))) {
-                continue;
-            }
+    // 如果是本机发送的数据包
+    if (ospf_hdr->router_id == ntohl(inet_addr(THIS_ROUTER_ID))) {
+        return;
+    }
+
+    // 区域与接收接口不符的报文丢弃（rfc2328 8.2），不支持虚链路
+    if (ospf_hdr->area_id != intf->area_id) {
+        intf->rx_bad_packets++;
+        return;
+    }
+
+    switch (ospf_hdr->type) {
+    case OSPF::Type::HELLO:
+        process_hello(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
+        break;
+    case OSPF::Type::DD:
+        process_dd(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
+        break;
+    case OSPF::Type::LSR:
+        process_lsr(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
+        break;
+    case OSPF::Type::LSU:
+        process_lsu(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
+        break;
+    case OSPF::Type::LSACK:
+        process_lsack(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * 批量接收：一次recvmmsg最多取回RECV_BATCH个帧，
+ * 帧缓冲区在recv线程内复用，不再逐包清零。
+ * 每个帧的缓冲区按最大的接口MTU分配，巨型帧的DD/LSU不会被截断。
+ */
+constexpr unsigned int RECV_BATCH = 32;
 
-            // 查找接口
-            // 这里是有问题的，因为组播不一定是这个接口收到的，但是我只有一个接口...
-            // 现在不需要了，因为接口对应了:)
-            // auto intf_it = std::find_if(this_interfaces.begin(), this_interfaces.end(), [dst_ip](Interface *intf) {
-            //     return dst_ip == intf->ip_addr || dst_ip == ntohl(inet_addr(ALL_SPF_ROUTERS));
-            // });
-            // if (intf_it == this_interfaces.end()) {
-            //     continue;
-            // }
-            // intf = *intf_it;
-
-            switch (ospf_hdr->type) {
-            case OSPF::Type::HELLO:
-                process_hello(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
-                break;
-            case OSPF::Type::DD:
-                process_dd(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
-                break;
-            case OSPF::Type::LSR:
-                process_lsr(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
-                break;
-            case OSPF::Type::LSU:
-                process_lsu(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
-                break;
-            case OSPF::Type::LSACK:
-                // process_lsack(intf, reinterpret_cast<char *>(ospf_hdr), src_ip);
-                break;
-            default:
-                break;
+struct RecvRing {
+    size_t frame_len;
+    std::vector<char> buf;
+    iovec iovs[RECV_BATCH];
+    mmsghdr msgs[RECV_BATCH];
+
+    explicit RecvRing(size_t frame_len) : frame_len(frame_len), buf(frame_len * RECV_BATCH) {
+        memset(msgs, 0, sizeof(msgs));
+        for (unsigned int i = 0; i < RECV_BATCH; ++i) {
+            iovs[i].iov_base = frame(i);
+            iovs[i].iov_len = frame_len;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    char *frame(unsigned int i) noexcept {
+        return buf.data() + frame_len * i;
+    }
+};
+
+// 读空一个接口上所有已到达的帧
+static void drain_interface(Interface *intf, RecvRing& ring) {
+    while (running) {
+        auto num_msgs = recvmmsg(intf->recv_fd, ring.msgs, RECV_BATCH, MSG_DONTWAIT, nullptr);
+        if (num_msgs < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("recv_loop: recvmmsg");
             }
+            return;
+        }
+        for (auto i = 0; i < num_msgs; ++i) {
+            handle_frame(intf, ring.frame(i), ring.msgs[i].msg_len);
+        }
+        // 不足一批说明队列已空
+        if (static_cast<unsigned int>(num_msgs) < RECV_BATCH) {
+            return;
         }
     }
 }
 
-void send_loop() {
-    char data[ETH_DATA_LEN];
+// 所有接口的recv_fd注册到同一个epoll实例，任一接口空闲都不会阻塞其他接口
+void recv_loop() {
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        perror("recv_loop: epoll_create1");
+        return;
+    }
+
+    for (auto& intf : this_interfaces) {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = intf;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, intf->recv_fd, &ev) < 0) {
+            perror("recv_loop: epoll_ctl");
+        }
+    }
+
+    // data.ptr为空表示唤醒事件
+    if (wakeup_fd >= 0) {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev);
+    }
+
+    // 体积较大，放在堆上
+    uint32_t max_mtu = ETH_DATA_LEN;
+    for (auto& intf : this_interfaces) {
+        max_mtu = std::max(max_mtu, intf->mtu);
+    }
+    std::unique_ptr<RecvRing> ring(new RecvRing(sizeof(ethhdr) + max_mtu));
+    epoll_event events[MAX_INTERFACE_NUM + 1];
     while (running) {
-        for (auto& intf : this_interfaces) {
-            if (intf->state == Interface::State::DOWN) {
+        // 没有eventfd时退化为定时检查running
+        auto num_events = epoll_wait(epoll_fd, events, MAX_INTERFACE_NUM + 1, wakeup_fd >= 0 ? -1 : 1000);
+        if (num_events < 0) {
+            if (errno == EINTR) {
                 continue;
             }
-
-            // Hello packet
-            if ((++intf->hello_timer) >= intf->hello_interval) {
-                intf->hello_timer = 0;
-                auto len = produce_hello(intf, data + sizeof(OSPF::Header));
-                send_packet(intf, data, len, OSPF::Type::HELLO, ntohl(inet_addr(ALL_SPF_ROUTERS)));
+            perror("recv_loop: epoll_wait");
+            break;
+        }
+        for (auto i = 0; i < num_events; ++i) {
+            auto intf = static_cast<Interface *>(events[i].data.ptr);
+            if (intf == nullptr) {
+                continue;
             }
+            drain_interface(intf, *ring);
+        }
+    }
 
-            // For each neighbor
-            for (auto& nbr : intf->neighbors) {
-                auto nbr_ip = nbr->ip_addr;
-                if (nbr->state == Neighbor::State::DOWN) {
-                    continue;
-                }
-
-                if ((++nbr->rxmt_timer) >= intf->rxmt_interval) {
-                    nbr->rxmt_timer = 0;
-
-                    // DD packet
-                    // Exstart状态，发送空的DD包
-                    if (nbr->state == Neighbor::State::EXSTART) {
-                        // 空的dd包只在此处生成
-                        nbr->last_dd_data_len = produce_dd(nbr->last_dd_data + sizeof(OSPF::Header), nbr);
-                        send_packet(intf, nbr->last_dd_data, nbr->last_dd_data_len, OSPF::Type::DD, nbr_ip);
-                    }
-                    // master + Exchange状态，没收到确认，重传dd包
-                    if (!nbr->is_master && nbr->state == Neighbor::State::EXCHANGE) {
-                        send_packet(intf, nbr->last_dd_data, nbr->last_dd_data_len, OSPF::Type::DD, nbr_ip);
-                    }
-
-                    // LSR packet
-                    if (nbr->state == Neighbor::State::EXCHANGE || nbr->state == Neighbor::State::LOADING) {
-                        auto len = produce_lsr(data + sizeof(OSPF::Header), nbr);
-                        if (len != 0) {
-                            send_packet(intf, data, len, OSPF::Type::LSR, nbr_ip);
-                        }
-                    }
-                }
-            }
+    close(epoll_fd);
+}
+
+// 路由计算线程，由SPF调度器节流
+void spf_loop() {
+    while (running && this_routing_table.wait_spf()) {
+        this_routing_table.update_route();
+    }
+}
+
+void stop() {
+    running = false;
+    this_routing_table.stop_spf();
+    this_timers.stop();
+    if (wakeup_fd >= 0) {
+        uint64_t one = 1;
+        if (write(wakeup_fd, &one, sizeof(one)) < 0) {
+            perror("stop: write wakeup_fd");
         }
+    }
+}
+
+void timer_loop() {
+    this_timers.run();
+}
+
+void send_hello(Interface *intf) {
+    char data[ETH_DATA_LEN];
+    auto len = produce_hello(intf, data + sizeof(OSPF::Header));
+    send_packet(intf, data, len, OSPF::Type::HELLO, ntohl(inet_addr(ALL_SPF_ROUTERS)));
+}
+
+void send_rxmt(Neighbor *nbr) {
+    auto intf = nbr->host_interface;
+    auto nbr_ip = nbr->ip_addr;
+
+    // DD packet
+    // Exstart状态，发送空的DD包
+    if (nbr->state == Neighbor::State::EXSTART) {
+        // 空的dd包只在此处生成
+        nbr->last_dd_data_len = produce_dd(nbr->last_dd_data.data() + sizeof(OSPF::Header), nbr);
+        send_packet(intf, nbr->last_dd_data.data(), nbr->last_dd_data_len, OSPF::Type::DD, nbr_ip);
+    }
+    // master + Exchange状态，没收到确认，重传dd包
+    if (!nbr->is_master && nbr->state == Neighbor::State::EXCHANGE) {
+        send_packet(intf, nbr->last_dd_data.data(), nbr->last_dd_data_len, OSPF::Type::DD, nbr_ip);
+    }
 
-        // 睡眠1s，实现timer
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+    // LSR packet
+    if (nbr->state == Neighbor::State::EXCHANGE || nbr->state == Neighbor::State::LOADING) {
+        send_lsr(nbr);
     }
 }
 
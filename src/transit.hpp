@@ -6,6 +6,7 @@
 #include "packet.hpp"
 
 class Interface;
+class Neighbor;
 
 namespace OSPF {
 
@@ -16,7 +17,18 @@ namespace OSPF {
 #endif
 
 void recv_loop();
-void send_loop();
+/* 唤醒recv线程的eventfd：在启动recv线程之前打开，在其结束之后关闭 */
+void open_wakeup();
+void close_wakeup();
+/* 运行时间轮，驱动所有协议定时器 */
+void timer_loop();
+void spf_loop();
+/* Hello计时器到期：在接口上发送Hello */
+void send_hello(Interface *intf);
+/* 重传计时器到期：按邻居状态重传DD、发送LSR */
+void send_rxmt(Neighbor *nbr);
+/* 置running为false并唤醒recv和spf线程 */
+void stop();
 
 extern std::atomic<bool> running;
 
@@ -2,76 +2,144 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <string>
 
 #include <arpa/inet.h>
 
-/* Fletcher checksum algorithm. */
-static inline uint16_t fletcher16(const void *data, size_t len, size_t off) {
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Fletcher校验和的两个累加和，c0 = Σb[i]，c1 = Σ(len-i)·b[i]，已对255取模。
+ * 按16字节分块：每块的字节和与按权重(16..1)的加权和一次算出，块间c1 += 16·c0，
+ * 有SSE2时用psadbw/pmaddwd并行计算，没有逐字节的分支；每64KB才取一次模。
+ */
+static inline void fletcher_sums(const void *data, size_t len, uint64_t& c0, uint64_t& c1) {
+    constexpr size_t BLOCK = 16;
+    constexpr size_t CHUNK = 1 << 16;
     const uint8_t *ptr = static_cast<const uint8_t *>(data);
-    int length = len;
-
-    int32_t x, y;
-    uint32_t mul;
-    uint32_t c0 = 0, c1 = 0;
-    uint16_t checksum = 0;
-
-    for (auto index = 0; index < length; index++) {
-        if (index == off || index == off + 1) {
-            c1 += c0;
-            ptr++;
-        } else {
-            c0 = c0 + *(ptr++);
-            c1 += c0;
+    uint64_t s0 = 0, s1 = 0;
+    while (len > 0) {
+        auto n = len < CHUNK ? len : CHUNK;
+        len -= n;
+        auto blocks = n / BLOCK;
+        n -= blocks * BLOCK;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weight_lo = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+        const __m128i weight_hi = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+        // 各块字节和的累计、累计值的前缀和、加权和
+        __m128i sum = zero, prefix = zero, weighted = zero;
+        for (size_t i = 0; i < blocks; ++i, ptr += BLOCK) {
+            auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+            prefix = _mm_add_epi64(prefix, sum);
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(bytes, zero));
+            weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weight_lo));
+            weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weight_hi));
+        }
+        uint64_t sums[2], prefixes[2];
+        uint32_t weights[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(sums), sum);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(prefixes), prefix);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(weights), weighted);
+        s1 += blocks * BLOCK * s0 + BLOCK * (prefixes[0] + prefixes[1]) + weights[0] + weights[1] + weights[2] +
+              weights[3];
+        s0 += sums[0] + sums[1];
+#else
+        for (size_t i = 0; i < blocks; ++i, ptr += BLOCK) {
+            uint32_t sum = 0, weighted = 0;
+            for (size_t k = 0; k < BLOCK; ++k) {
+                sum += ptr[k];
+                weighted += static_cast<uint32_t>(BLOCK - k) * ptr[k];
+            }
+            s1 += BLOCK * s0 + weighted;
+            s0 += sum;
+        }
+#endif
+        for (; n > 0; --n) {
+            s0 += *ptr++;
+            s1 += s0;
         }
+        s0 %= 255;
+        s1 %= 255;
     }
+    c0 = s0;
+    c1 = s1;
+}
 
-    c0 = c0 % 255;
-    c1 = c1 % 255;
-    mul = (length - off) * (c0);
-
-    x = mul - c0 - c1;
-    y = c1 - mul - 1;
-
-    if (y >= 0) {
-        y++;
-    }
-    if (x < 0) {
-        x--;
-    }
+/* Fletcher checksum algorithm. */
+// 计算时off处的两个字节（校验和字段）按0处理，结果写入该字段后整体的两个累加和均为0
+static inline uint16_t fletcher16(const void *data, size_t len, size_t off) {
+    const uint8_t *ptr = static_cast<const uint8_t *>(data);
+    uint64_t c0, c1;
+    fletcher_sums(data, len, c0, c1);
 
-    x %= 255;
-    y %= 255;
+    // 减去校验和字段的贡献
+    uint32_t b0 = ptr[off], b1 = ptr[off + 1];
+    c0 = (c0 + 2 * 255 - b0 - b1) % 255;
+    c1 = (c1 + 255 - ((len - off) % 255 * b0 + (len - off - 1) % 255 * b1) % 255) % 255;
 
+    // x·(len-off) + y·(len-off-1) + c1 ≡ 0，x + y + c0 ≡ 0（mod 255），且x、y不为0
+    int32_t x = static_cast<int32_t>(((len - off - 1) % 255 * c0 + 255 - c1) % 255);
     if (x == 0) {
         x = 255;
     }
-    if (y == 0) {
-        y = 255;
+    int32_t y = 510 - static_cast<int32_t>(c0) - x;
+    if (y > 255) {
+        y -= 255;
     }
-
-    y &= 0x00FF;
-
     return (x << 8) | y;
 }
 
-/* CRC checksum algorithm. */
-static inline uint16_t crc_checksum(const void *data, size_t len) {
-    uint32_t sum = 0;
-    const uint16_t *addr = static_cast<const uint16_t *>(data);
+/* 校验含校验和字段的数据，两个累加和都为0时正确 */
+static inline bool fletcher16_verify(const void *data, size_t len) {
+    uint64_t c0, c1;
+    fletcher_sums(data, len, c0, c1);
+    return c0 == 0 && c1 == 0;
+}
 
-    for (size_t i = 0; i < len / 2; ++i) {
-        sum += *addr++;
+/*
+ * 反码和的部分和（未折叠、未取反），可分段累加，除最后一段外各段长度须为偶数。
+ * 每次读入16字节、按32位累加到64位和中，4GB以内不会溢出。
+ */
+static inline uint64_t inet_sum(const void *data, size_t len, uint64_t sum = 0) {
+    const uint8_t *ptr = static_cast<const uint8_t *>(data);
+    for (; len >= 16; len -= 16, ptr += 16) {
+        uint32_t words[4];
+        memcpy(words, ptr, sizeof(words));
+        sum += (uint64_t)words[0] + words[1] + words[2] + words[3];
+    }
+    for (; len >= 2; len -= 2, ptr += 2) {
+        uint16_t word;
+        memcpy(&word, ptr, sizeof(word));
+        sum += word;
     }
     if (len & 1) {
-        sum += *reinterpret_cast<const uint8_t *>(addr);
+        // 末尾的单字节补0成一个16位字
+        uint8_t word[2] = {*ptr, 0};
+        uint16_t value;
+        memcpy(&value, word, sizeof(value));
+        sum += value;
     }
+    return sum;
+}
 
-    sum = (sum >> 16) + (sum & 0xffff);
-    sum += (sum >> 16);
+/* 将部分和折叠为16位并取反 */
+static inline uint16_t inet_fold(uint64_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
     return static_cast<uint16_t>(~sum);
 }
 
+/* CRC checksum algorithm. */
+// 实际是IP的反码和校验，结果已是网络字节序
+static inline uint16_t crc_checksum(const void *data, size_t len) {
+    return inet_fold(inet_sum(data, len));
+}
+
 constexpr bool is_little_endian() noexcept {
     return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
 }
@@ -0,0 +1,62 @@
+#include <algorithm>
+
+#include "workers.hpp"
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopped = true;
+        task_cv.notify_all();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(std::vector<Task>& tasks) {
+    if (tasks.size() <= 1) {
+        for (auto& task : tasks) {
+            task();
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mtx);
+    size_t limit = max_threads != 0 ? max_threads : std::max(1u, std::thread::hardware_concurrency());
+    // 调用者也领取任务，只需另外的wanted - 1个线程
+    auto wanted = std::min(tasks.size(), limit);
+    while (threads.size() + 1 < wanted) {
+        threads.emplace_back(&WorkerPool::worker, this);
+    }
+    batch = &tasks;
+    next = 0;
+    remaining = tasks.size();
+    task_cv.notify_all();
+
+    while (next < batch->size()) {
+        auto& task = (*batch)[next++];
+        lock.unlock();
+        task();
+        lock.lock();
+        remaining--;
+    }
+    done_cv.wait(lock, [this] { return remaining == 0; });
+    batch = nullptr;
+}
+
+void WorkerPool::worker() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopped) {
+        if (batch == nullptr || next >= batch->size()) {
+            task_cv.wait(lock);
+            continue;
+        }
+        auto& task = (*batch)[next++];
+        lock.unlock();
+        task();
+        lock.lock();
+        if (--remaining == 0) {
+            done_cv.notify_all();
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 执行一批互不依赖的任务并等待全部完成
+// 线程在第一次需要时创建并常驻，调用者线程同样领取任务；只有一个任务时不唤醒其它线程
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    WorkerPool() = default;
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /* 执行所有任务，返回时全部完成；不可重入 */
+    void run(std::vector<Task>& tasks);
+
+    /* 同时执行任务的最大线程数（含调用者），0为硬件线程数 */
+    size_t max_threads = 0;
+
+private:
+    std::mutex mtx;
+    std::condition_variable task_cv;
+    std::condition_variable done_cv;
+    std::vector<std::thread> threads;
+    bool stopped = false;
+
+    // 当前批次，next为下一个未领取的任务
+    std::vector<Task> *batch = nullptr;
+    size_t next = 0;
+    size_t remaining = 0;
+
+    void worker();
+};
@@ -30,6 +30,22 @@ target("ospf")
         "THIS_ROUTER_ID=\"1.1.1.1\""
     )
 
+-- 基准测试，由bench.sh在独立的网络命名空间中运行
+target("ospf-bench")
+    set_kind("binary")
+    set_default(false)
+    set_optimize("fastest")
+    add_files("src/*.cpp|main.cpp", "bench/*.cpp")
+    add_includedirs("src", "/usr/include")
+    add_linkdirs("/usr/lib")
+    add_syslinks("pthread")
+
+    add_defines(
+        "OSPF_VERSION=2",
+        "THIS_ROUTER_NAME=\"R0\"",
+        "THIS_ROUTER_ID=\"1.1.1.1\""
+    )
+
 task("fix-style")
     set_category("plugin")
     on_run(function ()
@@ -50,6 +66,9 @@ task("fix-style")
 -- ## Run target
 -- $ xmake run
 --
+-- ## Run benchmarks
+-- $ ./bench.sh [suite ...]
+--
 -- ## Format code
 -- $ xmake fix-style
 --
\ No newline at end of file